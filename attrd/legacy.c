@@ -740,7 +740,7 @@ main(int argc, char **argv)
         qb_ipcs_connection_unref(last);
     }
 
-    qb_ipcs_destroy(ipcs);
+    mainloop_del_ipc_server(ipcs);
 
     attrd_lrmd_disconnect();
     attrd_cib_disconnect();
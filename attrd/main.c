@@ -391,7 +391,7 @@ main(int argc, char **argv)
     election_fini(writer);
     if (ipcs) {
         crm_client_disconnect_all(ipcs);
-        qb_ipcs_destroy(ipcs);
+        mainloop_del_ipc_server(ipcs);
         g_hash_table_destroy(attributes);
     }
 
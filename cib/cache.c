@@ -0,0 +1,300 @@
+/*
+ * Copyright 2026 the Pacemaker project contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <crm_internal.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+
+#include <cibio.h>
+#include <callbacks.h>
+#include "common.h"
+#include "cache.h"
+
+/* Results of read-only XPath queries, so that tools and agents polling the
+ * same attributes don't re-run libxml's XPath engine against the whole CIB.
+ *
+ * Each entry records the literal "/cib/..." prefix its expression is confined
+ * to, and is dropped when an applied patchset touches anything that overlaps
+ * it.  Expressions that could reach outside such a prefix have no scope and
+ * are dropped by every change.
+ */
+#define CIB_QUERY_CACHE_MAX  256
+#define CIB_QUERY_CACHE_OPTS (cib_xpath | cib_no_children | cib_xpath_address)
+
+typedef struct cib_query_entry_s {
+    char *scope;
+    gboolean per_user;
+    int rc;
+    xmlNode *output;
+} cib_query_entry_t;
+
+static GHashTable *query_cache = NULL;
+static unsigned long query_hits = 0;
+static unsigned long query_misses = 0;
+static unsigned long query_dropped = 0;
+
+static void
+query_entry_free(gpointer data)
+{
+    cib_query_entry_t *entry = data;
+
+    free(entry->scope);
+    free_xml(entry->output);
+    free(entry);
+}
+
+static const char *
+query_user(xmlNode * request)
+{
+#if ENABLE_ACL
+    const char *user = crm_element_value(request, F_CIB_USER);
+
+    if (pcmk_acl_required(user)) {
+        return user;
+    }
+#endif
+    return NULL;
+}
+
+static char *
+query_key(int call_options, const char *section, const char *user)
+{
+    return crm_strdup_printf("%x %s %s", (call_options & CIB_QUERY_CACHE_OPTS),
+                             (user? user : "-"), section);
+}
+
+static gboolean
+query_cacheable(const char *op, int call_options, const char *section)
+{
+    return is_set(call_options, cib_xpath) && section != NULL
+           && safe_str_eq(op, CIB_OP_QUERY);
+}
+
+/*!
+ * \internal
+ * \brief Find the literal patchset path that an XPath expression stays within
+ *
+ * \return Newly allocated path, or NULL if the expression could match anywhere
+ */
+static char *
+query_scope(const char *xpath)
+{
+    int depth = 0;
+    const char *lpc = NULL;
+    const char *end = NULL;
+
+    /* Anything that could step outside its leading path defeats scoping */
+    if (strchr(xpath, '|') || strchr(xpath, '(') || strstr(xpath, "..")
+        || strstr(xpath, "::")) {
+        return NULL;
+    }
+
+    for (lpc = xpath; *lpc != 0; lpc++) {
+        if (*lpc == '[') {
+            depth++;
+        } else if (*lpc == ']') {
+            depth--;
+        } else if (*lpc == '/' && depth > 0) {
+            /* Predicates may refer to other parts of the document */
+            return NULL;
+        }
+    }
+
+    if (strncmp(xpath, "//" XML_TAG_CIB, 5) == 0) {
+        xpath++;
+    }
+    if (strncmp(xpath, "/" XML_TAG_CIB, 4) != 0
+        || (xpath[4] != 0 && xpath[4] != '/' && xpath[4] != '[')) {
+        return NULL;
+    }
+
+    end = xpath + 4;
+    while (end[0] == '/' && end[1] != '/' && end[1] != 0) {
+        const char *step = end + 1;
+        size_t len = strspn(step, "abcdefghijklmnopqrstuvwxyz"
+                                  "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-");
+
+        if (len == 0 || (step[len] != 0 && step[len] != '/' && step[len] != '[')) {
+            break;
+        }
+        end = step + len;
+    }
+    return strndup(xpath, end - xpath);
+}
+
+/*!
+ * \internal
+ * \brief Look for a cached result of a read-only query
+ *
+ * \param[in]  op            Requested operation
+ * \param[in]  call_options  Request options
+ * \param[in]  section       XPath expression
+ * \param[in]  request       Request, for the user it is run as
+ * \param[out] output        Where to store the cached output (owned by the cache)
+ * \param[out] rc            Where to store the cached result code
+ *
+ * \return TRUE if a cached result was found
+ */
+gboolean
+cib_query_cache_lookup(const char *op, int call_options, const char *section,
+                       xmlNode * request, xmlNode ** output, int *rc)
+{
+    char *key = NULL;
+    cib_query_entry_t *entry = NULL;
+
+    if (query_cache == NULL || query_cacheable(op, call_options, section) == FALSE) {
+        return FALSE;
+    }
+
+    key = query_key(call_options, section, query_user(request));
+    entry = g_hash_table_lookup(query_cache, key);
+    free(key);
+
+    if (entry == NULL) {
+        query_misses++;
+        return FALSE;
+    }
+
+    query_hits++;
+    if ((query_hits % 1000) == 0) {
+        crm_debug("Query cache: %lu hits, %lu misses, %lu dropped, %u entries",
+                  query_hits, query_misses, query_dropped, g_hash_table_size(query_cache));
+    }
+
+    crm_trace("Answering %s from the query cache", section);
+    *output = entry->output;
+    *rc = entry->rc;
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Remember the result of a read-only query
+ */
+void
+cib_query_cache_store(const char *op, int call_options, const char *section,
+                      xmlNode * request, int rc, xmlNode * output)
+{
+    const char *user = NULL;
+    cib_query_entry_t *entry = NULL;
+
+    if (query_cacheable(op, call_options, section) == FALSE
+        || (rc != pcmk_ok && rc != -ENXIO) || (output && output == the_cib)) {
+        return;
+    }
+
+    if (query_cache == NULL) {
+        query_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                            query_entry_free);
+
+    } else if (g_hash_table_size(query_cache) >= CIB_QUERY_CACHE_MAX) {
+        crm_debug("Query cache full, starting over");
+        query_dropped += g_hash_table_size(query_cache);
+        g_hash_table_remove_all(query_cache);
+    }
+
+    user = query_user(request);
+    entry = calloc(1, sizeof(cib_query_entry_t));
+    entry->scope = query_scope(section);
+    entry->per_user = (user != NULL);
+    entry->rc = rc;
+    entry->output = output? copy_xml(output) : NULL;
+
+    crm_trace("Caching %s (scope %s)", section, crm_str(entry->scope));
+    g_hash_table_replace(query_cache, query_key(call_options, section, user), entry);
+}
+
+static gboolean
+query_entry_affected(gpointer key, gpointer value, gpointer user_data)
+{
+    cib_query_entry_t *entry = value;
+    xmlNode *change = user_data;
+    char *path = cib_change_path(change);
+    gboolean affected = TRUE;
+
+    if (path == NULL || entry->scope == NULL) {
+        /* Be safe */
+
+    } else if (entry->per_user && cib_path_overlaps(path, "/" XML_TAG_CIB "/" XML_CIB_TAG_CONFIGURATION)) {
+        /* ACLs and whether they're enabled live in the configuration */
+
+    } else if (safe_str_eq(crm_element_value(change, XML_DIFF_OP), "modify")) {
+        /* Only the element's own attributes changed, so only queries that
+         * could return that element (or something below it) are affected
+         */
+        affected = cib_path_overlaps(path, entry->scope) && (strlen(path) >= strlen(entry->scope));
+
+    } else {
+        affected = cib_path_overlaps(path, entry->scope);
+    }
+
+    free(path);
+    if (affected) {
+        query_dropped++;
+    }
+    return affected;
+}
+
+/*!
+ * \internal
+ * \brief Drop cached query results that a patchset may have changed
+ *
+ * \param[in] patchset  Changes just applied to the_cib (NULL if none)
+ */
+void
+cib_query_cache_invalidate(xmlNode * patchset)
+{
+    int format = 1;
+    xmlNode *change = NULL;
+
+    if (query_cache == NULL || patchset == NULL || g_hash_table_size(query_cache) == 0) {
+        return;
+    }
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        query_dropped += g_hash_table_size(query_cache);
+        g_hash_table_remove_all(query_cache);
+        return;
+    }
+
+    for (change = __xml_first_child_element(patchset); change != NULL;
+         change = __xml_next_element(change)) {
+
+        if (safe_str_eq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            g_hash_table_foreach_remove(query_cache, query_entry_affected, change);
+        }
+    }
+}
+
+void
+cib_query_cache_cleanup(void)
+{
+    if (query_cache) {
+        crm_info("Query cache: %lu hits, %lu misses, %lu dropped",
+                 query_hits, query_misses, query_dropped);
+        g_hash_table_destroy(query_cache);
+        query_cache = NULL;
+    }
+}
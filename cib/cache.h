@@ -0,0 +1,31 @@
+/*
+ * Copyright 2026 the Pacemaker project contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef CIB_CACHE__H
+#  define CIB_CACHE__H
+
+#  include <glib.h>
+#  include <crm/common/xml.h>
+
+gboolean cib_query_cache_lookup(const char *op, int call_options, const char *section,
+                                xmlNode * request, xmlNode ** output, int *rc);
+void cib_query_cache_store(const char *op, int call_options, const char *section,
+                           xmlNode * request, int rc, xmlNode * output);
+void cib_query_cache_invalidate(xmlNode * patchset);
+void cib_query_cache_cleanup(void);
+
+#endif
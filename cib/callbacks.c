@@ -33,12 +33,14 @@
 #include <crm/cluster/internal.h>
 
 #include <crm/common/xml.h>
+#include <crm/common/xml_internal.h>
 
 #include <cibio.h>
 #include <callbacks.h>
 #include <cibmessages.h>
 #include <notify.h>
 #include "common.h"
+#include "cache.h"
 
 static unsigned long cib_local_bcast_num = 0;
 
@@ -154,6 +156,7 @@ cib_ipc_closed(qb_ipcs_connection_t * c)
         return 0;
     }
     crm_trace("Connection %p", c);
+    cib_notify_filter_clear(client);
     crm_client_destroy(client);
     return 0;
 }
@@ -205,8 +208,10 @@ cib_common_callback_worker(uint32_t id, uint32_t flags, xmlNode * op_request,
     } else if (crm_str_eq(op, T_CIB_NOTIFY, TRUE)) {
         /* Update the notify filters for this client */
         int on_off = 0;
+        int rc = pcmk_ok;
         long long bit = 0;
         const char *type = crm_element_value(op_request, F_CIB_NOTIFY_TYPE);
+        const char *filter = crm_element_value(op_request, F_CIB_NOTIFY_FILTER);
 
         crm_element_value_int(op_request, F_CIB_NOTIFY_ACTIVATE, &on_off);
 
@@ -229,17 +234,48 @@ cib_common_callback_worker(uint32_t id, uint32_t flags, xmlNode * op_request,
             bit = cib_notify_replace;
         }
 
-        if (on_off) {
+        if (bit == cib_notify_diff && filter != NULL) {
+            /* Narrow (or widen) the set of changes this client is sent */
+            rc = cib_notify_filter_diffs(cib_client, filter, on_off);
+            if (on_off && rc == pcmk_ok) {
+                set_bit(cib_client->options, bit);
+            }
+
+        } else if (on_off) {
             set_bit(cib_client->options, bit);
+
         } else {
             clear_bit(cib_client->options, bit);
+            if (bit == cib_notify_diff) {
+                cib_notify_filter_clear(cib_client);
+            }
         }
 
-        if (flags & crm_ipc_client_response) {
+        if ((flags & crm_ipc_client_response) && rc != pcmk_ok) {
+            xmlNode *ack = create_xml_node(NULL, "ack");
+
+            crm_xml_add(ack, F_CIB_OPERATION, T_CIB_NOTIFY);
+            crm_xml_add_int(ack, F_CIB_RC, rc);
+            crm_ipcs_send(cib_client, id, ack, flags);
+            cib_client->request_id = 0;
+            free_xml(ack);
+
+        } else if (flags & crm_ipc_client_response) {
             /* TODO - include rc */
             crm_ipcs_send_ack(cib_client, id, flags, "ack", __FUNCTION__, __LINE__);
         }
         return;
+
+    } else if (crm_str_eq(op, CIB_OP_QUERY, TRUE) && cib_client->kind == CRM_CLIENT_IPC
+               && crm_element_value(op_request, F_CIB_HOST) == NULL
+               && pcmk_acl_required(cib_client->user) == FALSE) {
+        int call_options = 0;
+
+        /* A local reader that could use the snapshot had to ask us instead */
+        crm_element_value_int(op_request, F_CIB_CALLOPTS, &call_options);
+        if (call_options & cib_sync_call) {
+            cib_snapshot_wanted();
+        }
     }
 
     cib_process_request(op_request, FALSE, privileged, FALSE, cib_client);
@@ -369,21 +405,33 @@ process_ping_reply(xmlNode *reply)
 
     } else {
         const char *version = crm_element_value(pong, XML_ATTR_CRM_VERSION);
+        const char *local_digest = NULL;
+        char *merkle_digest = NULL;
+
+        if(version && compare_version(version, CRM_MERKLE_DIGEST_VERSION) >= 0) {
+            /* The peer used the format we asked for.  Only the root needs
+             * recalculating here, so there is nothing worth caching.
+             */
+            merkle_digest = calculate_xml_merkle_digest(the_cib, TRUE);
+            local_digest = merkle_digest;
 
-        if(ping_digest == NULL) {
-            crm_trace("Calculating new digest");
-            ping_digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE, version);
+        } else {
+            if(ping_digest == NULL) {
+                crm_trace("Calculating new digest");
+                ping_digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE, version);
+            }
+            local_digest = ping_digest;
         }
 
         crm_trace("Processing ping reply %s from %s (%s)", seq_s, host, digest);
-        if(safe_str_eq(ping_digest, digest) == FALSE) {
+        if(safe_str_eq(local_digest, digest) == FALSE) {
             xmlNode *remote_cib = get_message_xml(pong, F_CIB_CALLDATA);
 
             crm_notice("Local CIB %s.%s.%s.%s differs from %s: %s.%s.%s.%s %p",
                        crm_element_value(the_cib, XML_ATTR_GENERATION_ADMIN),
                        crm_element_value(the_cib, XML_ATTR_GENERATION),
                        crm_element_value(the_cib, XML_ATTR_NUMUPDATES),
-                       ping_digest, host,
+                       local_digest, host,
                        remote_cib?crm_element_value(remote_cib, XML_ATTR_GENERATION_ADMIN):"_",
                        remote_cib?crm_element_value(remote_cib, XML_ATTR_GENERATION):"_",
                        remote_cib?crm_element_value(remote_cib, XML_ATTR_NUMUPDATES):"_",
@@ -396,9 +444,11 @@ process_ping_reply(xmlNode *reply)
                 crm_trace("End of differences");
             }
 
-            free_xml(remote_cib);
+            /* The peer's version is needed to send it just what it's missing */
             sync_our_cib(reply, FALSE);
+            free_xml(remote_cib);
         }
+        free(merkle_digest);
     }
 }
 
@@ -727,7 +777,7 @@ parse_peer_options_v2(int call_type, xmlNode * request,
 
     gboolean is_reply = safe_str_eq(reply_to, cib_our_uname);
 
-    if(safe_str_eq(op, CIB_OP_REPLACE)) {
+    if(safe_str_eq(op, CIB_OP_REPLACE) || safe_str_eq(op, CIB_OP_SYNC_DELTA)) {
         /* sync_our_cib() sets F_CIB_ISREPLY */
         if (reply_to) {
             delegated = reply_to;
@@ -1205,6 +1255,7 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
     gboolean global_update = FALSE;
     gboolean config_changed = FALSE;
     gboolean manage_counters = TRUE;
+    gboolean cached_output = FALSE;
 
     static mainloop_timer_t *digest_timer = NULL;
 
@@ -1237,11 +1288,18 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         goto done;
 
     } else if (cib_op_modifies(call_type) == FALSE) {
+        cached_output = cib_query_cache_lookup(op, call_options, section, request,
+                                               &output, &rc);
+        if (cached_output) {
+            goto done;
+        }
+
         rc = cib_perform_op(op, call_options, cib_op_func(call_type), TRUE,
                             section, request, input, FALSE, &config_changed,
                             current_cib, &result_cib, NULL, &output);
 
         CRM_CHECK(result_cib == NULL, free_xml(result_cib));
+        cib_query_cache_store(op, call_options, section, request, rc, output);
         goto done;
     }
 
@@ -1253,7 +1311,8 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         call_options |= cib_force_diff;
         crm_trace("Global update detected");
 
-        CRM_CHECK(call_type == 3 || call_type == 4, crm_err("Call type: %d", call_type);
+        CRM_CHECK(call_type == 3 || call_type == 4 || safe_str_eq(op, CIB_OP_SYNC_DELTA),
+                  crm_err("Call type: %d", call_type);
                   crm_log_xml_err(request, "bad op"));
     }
 
@@ -1265,8 +1324,12 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
             manage_counters = FALSE;
         }
 
-        if (is_not_set(call_options, cib_dryrun) && safe_str_eq(section, XML_CIB_TAG_STATUS)) {
-            /* Copying large CIBs accounts for a huge percentage of our CIB usage */
+        if (is_not_set(call_options, cib_dryrun)
+            && cib_op_targets_status(section, call_options)) {
+            /* Copying large CIBs accounts for a huge percentage of our CIB usage.
+             * Status-only changes (including XPath deletions of node history
+             * and transient attributes) are applied in place and tracked.
+             */
             call_options |= cib_zero_copy;
         } else {
             clear_bit(call_options, cib_zero_copy);
@@ -1306,9 +1369,26 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
                   (is_set(call_options, cib_zero_copy)? " zero-copy" : ""),
                   (config_changed? " changed" : ""));
         if(is_not_set(call_options, cib_zero_copy)) {
-            rc = activateCibXml(result_cib, config_changed, op);
+            rc = activateCibXml(result_cib, config_changed, op, *cib_diff);
             crm_trace("Activated %s (%d)",
                       crm_element_value(current_cib, XML_ATTR_NUMUPDATES), rc);
+
+        } else {
+            /* the_cib was modified in place */
+            cib_snapshot_invalidate();
+        }
+
+        if (rc == pcmk_ok && crm_str_eq(CIB_OP_REPLACE, op, TRUE)) {
+            /* Full syncs arrive as replacements too, and either way the
+             * existing history no longer leads to the_cib
+             */
+            cib_diff_ring_clear();
+            cib_query_cache_invalidate(*cib_diff);
+
+        } else if (rc == pcmk_ok) {
+            /* Keep the history needed to catch up lagging peers */
+            cib_diff_ring_add(*cib_diff);
+            cib_query_cache_invalidate(*cib_diff);
         }
 
         if (rc == pcmk_ok && cib_internal_config_changed(*cib_diff)) {
@@ -1389,7 +1469,11 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
 
     crm_trace("cleanup");
 
-    if (cib_op_modifies(call_type) == FALSE && output != current_cib) {
+    if (cached_output) {
+        /* Owned by the query cache */
+        output = NULL;
+
+    } else if (cib_op_modifies(call_type) == FALSE && output != current_cib) {
         free_xml(output);
         output = NULL;
     }
@@ -1734,6 +1818,9 @@ terminate_cib(const char *caller, int fast)
         remote_tls_fd = 0;
     }
 
+    if (fast >= 0) {
+        cib_journal_flush();
+    }
     uninitializeCib();
 
     if (fast < 0) {
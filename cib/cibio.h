@@ -41,7 +41,12 @@ extern gboolean verifyCibXml(xmlNode * cib);
 extern xmlNode *readCibXml(char *buffer);
 extern xmlNode *readCibXmlFile(const char *dir, const char *file, gboolean discard_status);
 extern int activateCibBuffer(char *buffer, const char *filename);
-extern int activateCibXml(xmlNode * doc, gboolean to_disk, const char *op);
+extern int activateCibXml(xmlNode * doc, gboolean to_disk, const char *op,
+                          xmlNode * patchset);
+extern void cib_snapshot_invalidate(void);
+extern void cib_snapshot_wanted(void);
+extern void cib_snapshot_remove(void);
+extern void cib_journal_flush(void);
 extern crm_trigger_t *cib_writer;
 extern volatile gboolean cib_writes_enabled;
 
@@ -70,7 +70,14 @@ int cib_process_upgrade_server(const char *op, int options, const char *section,
                                xmlNode * existing_cib, xmlNode ** result_cib,
                                xmlNode ** answer);
 
+extern int cib_process_sync_delta(const char *op, int options, const char *section,
+                                  xmlNode * req, xmlNode * input,
+                                  xmlNode * existing_cib, xmlNode ** result_cib,
+                                  xmlNode ** answer);
+
 void send_sync_request(const char *host);
+void cib_diff_ring_add(xmlNode * patchset);
+void cib_diff_ring_clear(void);
 
 
 #endif
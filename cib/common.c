@@ -197,6 +197,7 @@ static cib_operation_t cib_server_ops[] = {
     {CIB_OP_ERASE,     TRUE,  TRUE,  TRUE,  cib_prepare_none, cib_cleanup_output, cib_process_erase},
     {CRM_OP_NOOP,      FALSE, FALSE, FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_default},
     {CIB_OP_DELETE_ALT,TRUE,  TRUE,  TRUE,  cib_prepare_data, cib_cleanup_data,   cib_process_delete_absolute},
+    {CIB_OP_TRANSACTION,TRUE, TRUE,  TRUE,  cib_prepare_data, cib_cleanup_data,   cib_process_transaction},
     {CIB_OP_UPGRADE,   TRUE,  TRUE,  TRUE,  cib_prepare_none, cib_cleanup_output, cib_process_upgrade_server},
     {CIB_OP_SLAVE,     FALSE, TRUE,  FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_readwrite},
     {CIB_OP_SLAVEALL,  FALSE, TRUE,  FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_readwrite},
@@ -205,6 +206,7 @@ static cib_operation_t cib_server_ops[] = {
     {CIB_OP_ISMASTER,  FALSE, TRUE,  FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_readwrite},
     {"cib_shutdown_req",FALSE, TRUE, FALSE, cib_prepare_sync, cib_cleanup_sync,   cib_process_shutdown_req},
     {CRM_OP_PING,      FALSE, FALSE, FALSE, cib_prepare_none, cib_cleanup_output, cib_process_ping},
+    {CIB_OP_SYNC_DELTA,TRUE,  TRUE,  FALSE, cib_prepare_data, cib_cleanup_data,   cib_process_sync_delta},
 };
 /* *INDENT-ON* */
 
@@ -273,7 +275,8 @@ cib_msg_copy(xmlNode * msg, gboolean with_data)
         F_CIB_USER,
 #endif
         F_CIB_NOTIFY_TYPE,
-        F_CIB_NOTIFY_ACTIVATE
+        F_CIB_NOTIFY_ACTIVATE,
+        F_CIB_NOTIFY_FILTER
     };
 
     static const char *data_list[] = {
@@ -347,3 +350,55 @@ cib_op_cleanup(int call_type, int options, xmlNode ** input, xmlNode ** output)
     crm_trace("Cleanup %d", call_type);
     return cib_server_ops[call_type].cleanup(options, input, output);
 }
+
+/*!
+ * \internal
+ * \brief Check whether either of two patchset paths contains the other
+ */
+gboolean
+cib_path_overlaps(const char *path, const char *other)
+{
+    size_t p_len = strlen(path);
+    size_t o_len = strlen(other);
+
+    if (p_len >= o_len) {
+        return (strncmp(path, other, o_len) == 0)
+               && (path[o_len] == 0 || path[o_len] == '/' || path[o_len] == '[');
+    }
+    return (strncmp(other, path, p_len) == 0)
+           && (other[p_len] == '/' || other[p_len] == '[');
+}
+
+/*!
+ * \internal
+ * \brief Get the path of the element a v2 patchset change affects
+ *
+ * \param[in] change  Change element from a v2 patchset
+ *
+ * \return Newly allocated path, or NULL if the change has none
+ * \note Creations are reported against the parent, so the created
+ *       element is appended to the path for those.
+ */
+char *
+cib_change_path(xmlNode * change)
+{
+    xmlNode *child = NULL;
+    const char *op = crm_element_value(change, XML_DIFF_OP);
+    const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    if (safe_str_eq(op, "create")) {
+        child = __xml_first_child_element(change);
+    }
+
+    if (child && ID(child)) {
+        return crm_strdup_printf("%s/%s[@id='%s']", path, crm_element_name(child), ID(child));
+
+    } else if (child) {
+        return crm_strdup_printf("%s/%s", path, crm_element_name(child));
+    }
+    return strdup(path);
+}
@@ -30,6 +30,9 @@ extern int cib_op_cleanup(int call_type, int options, xmlNode ** input, xmlNode
 extern int cib_op_can_run(int call_type, int call_options, gboolean privileged,
                           gboolean global_update);
 
+extern gboolean cib_path_overlaps(const char *path, const char *other);
+extern char *cib_change_path(xmlNode * change);
+
 
 extern GMainLoop *mainloop;
 extern crm_cluster_t crm_cluster;
@@ -30,6 +30,8 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include <crm/crm.h>
 
@@ -50,6 +52,27 @@ extern int cib_status;
 
 int write_cib_contents(gpointer p);
 
+/* Configuration changes are appended to CIB_JOURNAL_FILE as v2 patchsets,
+ * and cib.xml is only rewritten (compacting the journal) once it grows past
+ * these limits, or when we exit.
+ */
+#define CIB_JOURNAL_MAX_RECORDS 100
+#define CIB_JOURNAL_MAX_BYTES   (1024 * 1024)
+
+/* Records are flushed to disk in batches, at most this long after writing */
+#define CIB_JOURNAL_SYNC_MS     100
+
+static int journal_fd = -1;
+static mainloop_timer_t *journal_sync_timer = NULL;
+static int journal_records = 0;
+static off_t journal_bytes = 0;
+
+/* admin_epoch and epoch of the CIB being written by the disk writer */
+static int journal_snapshot[] = { -1, -1 };
+
+/* Forked disk writer, if one is running */
+static pid_t writer_pid = 0;
+
 static void
 cib_rename(const char *old)
 {
@@ -189,6 +212,300 @@ static int cib_archive_sort(const struct dirent ** a, const struct dirent **b)
     return rc;
 }
 
+static char *
+cib_journal_path(void)
+{
+    return crm_concat(cib_root, CIB_JOURNAL_FILE, '/');
+}
+
+/*!
+ * \internal
+ * \brief Apply journalled changes newer than a CIB read from disk
+ *
+ * The journal is truncated after the last record that could be applied
+ * (or was already contained in \p root), so that later records are
+ * appended to a valid prefix.
+ *
+ * \param[in,out] root  CIB read from disk
+ */
+static void
+cib_journal_replay(xmlNode *root)
+{
+    size_t max = 0;
+    int applied = 0;
+    char *path = cib_journal_path();
+    char *contents = crm_read_contents(path);
+
+    if (contents == NULL) {
+        if (errno != 0 && errno != ENOENT) {
+            crm_perror(LOG_WARNING, "Could not read CIB journal %s", path);
+        }
+        journal_records = 0;
+        journal_bytes = 0;
+        free(path);
+        return;
+    }
+
+    max = strlen(contents);
+    journal_bytes = cib_file_journal_replay(root, contents, max, &journal_records, &applied);
+
+    if (journal_bytes < max) {
+        crm_warn("Discarding the last %lu bytes of CIB journal %s",
+                 (unsigned long) (max - journal_bytes), path);
+        if (truncate(path, journal_bytes) < 0) {
+            crm_perror(LOG_ERR, "Could not truncate %s", path);
+        }
+    }
+
+    if (applied) {
+        crm_notice("Applied %d journalled change%s to the on-disk CIB",
+                   applied, (applied == 1)? "" : "s");
+    }
+
+    free(contents);
+    free(path);
+}
+
+/*!
+ * \internal
+ * \brief Remove changes to the status section from a patchset
+ *
+ * The status section is never written to disk, so such changes could not
+ * be replayed.
+ */
+static void
+cib_journal_strip_status(xmlNode *patchset)
+{
+    xmlNode *change = __xml_first_child(patchset);
+
+    while (change != NULL) {
+        xmlNode *next = __xml_next(change);
+        const char *op = crm_element_value(change, XML_DIFF_OP);
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+        if (safe_str_neq((const char *) change->name, XML_DIFF_CHANGE)) {
+            /* Version details etc. */
+
+        } else if (path && strstr(path, "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS) == path) {
+            free_xml(change);
+
+        } else if (safe_str_eq(op, "create") && safe_str_eq(path, "/" XML_TAG_CIB)
+                   && change->children
+                   && safe_str_eq(crm_element_name(change->children), XML_CIB_TAG_STATUS)) {
+            free_xml(change);
+        }
+        change = next;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Flush journal records written since the last sync to disk
+ *
+ * If that fails, the whole CIB is written out instead (which also
+ * compacts the journal).
+ */
+static gboolean
+cib_journal_sync(gpointer data)
+{
+    if ((journal_fd >= 0) && (fdatasync(journal_fd) < 0)) {
+        crm_perror(LOG_ERR, "Could not sync CIB journal, writing the full CIB instead");
+        close(journal_fd);
+        journal_fd = -1;
+        mainloop_set_trigger(cib_writer);
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Append a configuration change to the journal
+ *
+ * The record is synced to disk shortly afterwards, along with any others
+ * written in the meantime, so the main loop isn't held up by every change.
+ *
+ * \param[in] op        Operation that resulted in \p patchset
+ * \param[in] patchset  Changes made by \p op
+ *
+ * \return TRUE if the change was journalled, FALSE if cib.xml needs to be
+ *         rewritten instead (including when the change leaves the
+ *         configuration version unchanged)
+ */
+static gboolean
+cib_journal_append(const char *op, xmlNode *patchset)
+{
+    int format = 1;
+    ssize_t rc = 0;
+    size_t length = 0;
+    char *header = NULL;
+    char *digest = NULL;
+    char *payload = NULL;
+    xmlNode *copy = NULL;
+    struct iovec iov[3];
+    int add[] = { 0, 0, 0 };
+    int del[] = { 0, 0, 0 };
+    static char newline[] = "\n";
+
+    if (patchset == NULL || safe_str_eq(op, CIB_OP_REPLACE)) {
+        return FALSE;
+    }
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        return FALSE;
+    }
+
+    /* Replay tells which records cib.xml already contains by their version,
+     * so changes that don't bump it (made without managing the counters)
+     * have to be written out in full
+     */
+    xml_patch_versions(patchset, add, del);
+    if (cib_file_journal_version_cmp(add, del) <= 0) {
+        crm_trace("Not journalling %s op that left the version at %d.%d",
+                  op, add[0], add[1]);
+        return FALSE;
+    }
+
+    if (journal_fd < 0) {
+        char *path = cib_journal_path();
+
+        /* The mode is explicit, so there is no need to touch the umask */
+        journal_fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+        if (journal_fd < 0) {
+            crm_perror(LOG_ERR, "Could not open CIB journal %s", path);
+        }
+        free(path);
+        if (journal_fd < 0) {
+            return FALSE;
+        }
+
+        /* Records are only durable once the journal's directory entry is */
+        crm_sync_directory(cib_root);
+    }
+
+    /* The digest covers the status section too, which replay won't have */
+    copy = copy_xml(patchset);
+    xml_remove_prop(copy, XML_ATTR_DIGEST);
+    cib_journal_strip_status(copy);
+
+    payload = dump_xml_unformatted(copy);
+    free_xml(copy);
+
+    digest = crm_md5sum(payload);
+    header = crm_strdup_printf("%lu %s\n", (unsigned long) strlen(payload), digest);
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = strlen(header);
+    iov[1].iov_base = payload;
+    iov[1].iov_len = strlen(payload);
+    iov[2].iov_base = newline;
+    iov[2].iov_len = 1;
+    length = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    rc = writev(journal_fd, iov, DIMOF(iov));
+    if (rc == (ssize_t) length) {
+        journal_records++;
+        journal_bytes += length;
+        crm_trace("Journalled %s op (%lu bytes)", op, (unsigned long) length);
+
+        if (journal_sync_timer == NULL) {
+            journal_sync_timer = mainloop_timer_add("cib-journal-sync", CIB_JOURNAL_SYNC_MS,
+                                                    FALSE, cib_journal_sync, NULL);
+        }
+        if (mainloop_timer_running(journal_sync_timer) == FALSE) {
+            mainloop_timer_start(journal_sync_timer);
+        }
+
+    } else {
+        crm_perror(LOG_ERR, "Could not journal %s op", op);
+
+        /* Don't leave a partial record that later ones would follow */
+        if (ftruncate(journal_fd, journal_bytes) < 0) {
+            crm_perror(LOG_ERR, "Could not discard partial CIB journal record");
+        }
+        close(journal_fd);
+        journal_fd = -1;
+        rc = -1;
+    }
+
+    free(header);
+    free(digest);
+    free(payload);
+    return (rc >= 0);
+}
+
+/*!
+ * \internal
+ * \brief Drop journal records contained in a newly written cib.xml
+ *
+ * Records appended while the disk writer was running are preserved.
+ */
+static void
+cib_journal_compact(void)
+{
+    int fd = -1;
+    int records = 0;
+    size_t max = 0;
+    size_t offset = 0;
+    size_t start = 0;
+    xmlNode *patchset = NULL;
+    GString *kept = g_string_new(NULL);
+    char *path = cib_journal_path();
+    char *tmp = crm_strdup_printf("%s/cib.journal.XXXXXX", cib_root);
+    char *contents = crm_read_contents(path);
+
+    if (contents) {
+        max = strlen(contents);
+    }
+
+    while (contents && (patchset = cib_file_journal_next(contents, max, &offset)) != NULL) {
+        int add[] = { 0, 0, 0 };
+        int del[] = { 0, 0, 0 };
+
+        xml_patch_versions(patchset, add, del);
+        if (cib_file_journal_version_cmp(add, journal_snapshot) > 0) {
+            g_string_append_len(kept, contents + start, offset - start);
+            records++;
+        }
+        free_xml(patchset);
+        start = offset;
+    }
+
+    /* Kept records are synced as part of the new file */
+    if (journal_sync_timer) {
+        mainloop_timer_stop(journal_sync_timer);
+    }
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        crm_perror(LOG_ERR, "Could not create temporary file for CIB journal");
+
+    } else if (crm_write_sync(fd, kept->str) < 0) {
+        crm_perror(LOG_ERR, "Could not write compacted CIB journal");
+        unlink(tmp);
+
+    } else if (rename(tmp, path) < 0) {
+        crm_perror(LOG_ERR, "Could not rename %s as %s", tmp, path);
+        unlink(tmp);
+
+    } else {
+        crm_sync_directory(cib_root);
+        journal_records = records;
+        journal_bytes = kept->len;
+        crm_debug("Compacted CIB journal to %d record%s",
+                  journal_records, (journal_records == 1)? "" : "s");
+    }
+
+    g_string_free(kept, TRUE);
+    free(contents);
+    free(path);
+    free(tmp);
+}
+
 xmlNode *
 readCibXmlFile(const char *dir, const char *file, gboolean discard_status)
 {
@@ -270,6 +587,11 @@ readCibXmlFile(const char *dir, const char *file, gboolean discard_status)
         create_xml_node(root, XML_CIB_TAG_STATUS);
     }
 
+    /* Bring the configuration up to date with any changes made since
+     * cib.xml was last written
+     */
+    cib_journal_replay(root);
+
     /* Do this before DTD validation happens */
 
     /* fill in some defaults */
@@ -373,12 +695,160 @@ initializeCib(xmlNode * new_cib)
     return TRUE;
 }
 
+/* Republish the read-only snapshot at most this often while it is in use */
+#define CIB_SNAPSHOT_DELAY_MS 1000
+
+static uint64_t snapshot_epoch = 0;
+static gboolean snapshot_disabled = FALSE;
+static cib_snapshot_header_t *snapshot_published = NULL;
+static mainloop_timer_t *snapshot_timer = NULL;
+
+static gboolean
+cib_snapshot_publish(gpointer data)
+{
+    int fd = -1;
+    char *buffer = NULL;
+    char *tmp = NULL;
+    struct iovec iov[2];
+    ssize_t length = 0;
+    cib_snapshot_header_t header;
+
+    if (the_cib == NULL || snapshot_disabled) {
+        return FALSE;
+    }
+
+    buffer = dump_xml_unformatted(the_cib);
+    CRM_CHECK(buffer != NULL, return FALSE);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CIB_SNAPSHOT_MAGIC;
+    header.format = CIB_SNAPSHOT_FORMAT;
+    header.epoch = snapshot_epoch;
+    header.length = strlen(buffer) + 1;
+    header.pid = getpid();
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = buffer;
+    iov[1].iov_len = header.length;
+    length = iov[0].iov_len + iov[1].iov_len;
+
+    tmp = crm_strdup_printf("%s.XXXXXX", CIB_SNAPSHOT_FILE);
+    fd = mkstemp(tmp);
+    if (fd < 0 || fchmod(fd, S_IRUSR | S_IWUSR) < 0
+        || writev(fd, iov, DIMOF(iov)) != length) {
+
+        /* Not fatal, readers just keep asking us over IPC */
+        crm_perror(LOG_INFO, "Disabling CIB snapshots after failing to write %s", tmp);
+        snapshot_disabled = TRUE;
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        goto done;
+    }
+
+    if (rename(tmp, CIB_SNAPSHOT_FILE) < 0) {
+        crm_perror(LOG_INFO, "Disabling CIB snapshots after failing to replace %s",
+                   CIB_SNAPSHOT_FILE);
+        snapshot_disabled = TRUE;
+        close(fd);
+        unlink(tmp);
+        goto done;
+    }
+
+    /* Keep the header mapped so it can be marked stale without a syscall */
+    if (snapshot_published) {
+        munmap(snapshot_published, sizeof(cib_snapshot_header_t));
+    }
+    snapshot_published = mmap(NULL, sizeof(cib_snapshot_header_t), PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+    if (snapshot_published == MAP_FAILED) {
+        /* Unsafe to leave readers with a snapshot we can't invalidate */
+        crm_perror(LOG_INFO, "Disabling CIB snapshots after failing to map %s",
+                   CIB_SNAPSHOT_FILE);
+        snapshot_published = NULL;
+        snapshot_disabled = TRUE;
+        unlink(CIB_SNAPSHOT_FILE);
+    }
+    close(fd);
+
+    crm_trace("Published CIB snapshot %llu (%d bytes)",
+              (unsigned long long) snapshot_epoch, (int) length);
+
+  done:
+    free(tmp);
+    free(buffer);
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Withdraw the published CIB snapshot
+ */
+void
+cib_snapshot_remove(void)
+{
+    if (snapshot_published) {
+        snapshot_published->stale = TRUE;
+        munmap(snapshot_published, sizeof(cib_snapshot_header_t));
+        snapshot_published = NULL;
+    }
+    unlink(CIB_SNAPSHOT_FILE);
+
+    if (snapshot_timer) {
+        mainloop_timer_del(snapshot_timer);
+        snapshot_timer = NULL;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Mark the published CIB snapshot stale
+ *
+ * \note Call whenever the_cib is replaced or modified in place.
+ */
+void
+cib_snapshot_invalidate(void)
+{
+    snapshot_epoch++;
+    if (snapshot_published) {
+        snapshot_published->stale = TRUE;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Schedule a new CIB snapshot if the published one is not current
+ *
+ * \note Call when a local query arrives that the snapshot could have
+ *       answered, so that the CIB is not re-serialized while nobody reads it.
+ */
+void
+cib_snapshot_wanted(void)
+{
+    if (snapshot_disabled
+        || (snapshot_published && snapshot_published->stale == FALSE)) {
+        return;
+
+    } else if (snapshot_timer == NULL) {
+        /* Don't let readers see anything left behind by a previous instance */
+        unlink(CIB_SNAPSHOT_FILE);
+        snapshot_timer = mainloop_timer_add("cib-snapshot", CIB_SNAPSHOT_DELAY_MS, FALSE,
+                                            cib_snapshot_publish, NULL);
+    }
+
+    if (mainloop_timer_running(snapshot_timer) == FALSE) {
+        mainloop_timer_start(snapshot_timer);
+    }
+}
+
 /*
  * This method will free the old CIB pointer on success and the new one
  * on failure.
  */
 int
-activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
+activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op, xmlNode * patchset)
 {
     xmlNode *saved_cib = the_cib;
 
@@ -402,9 +872,16 @@ activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
     }
 
     free_xml(saved_cib);
+    cib_snapshot_invalidate();
+
     if (cib_writes_enabled && cib_status == pcmk_ok && to_disk) {
-        crm_debug("Triggering CIB write for %s op", op);
-        mainloop_set_trigger(cib_writer);
+        if (cib_journal_append(op, patchset) == FALSE
+            || journal_records >= CIB_JOURNAL_MAX_RECORDS
+            || journal_bytes >= CIB_JOURNAL_MAX_BYTES) {
+
+            crm_debug("Triggering CIB write for %s op", op);
+            mainloop_set_trigger(cib_writer);
+        }
     }
 
     return pcmk_ok;
@@ -422,9 +899,13 @@ cib_diskwrite_complete(mainloop_child_t * p, pid_t pid, int core, int signo, int
                    pid, exitcode);
     }
 
+    writer_pid = 0;
     if (exitcode != 0 && cib_writes_enabled) {
         crm_err("Disabling disk writes after write failure");
         cib_writes_enabled = FALSE;
+
+    } else if (exitcode == 0 && signo == 0) {
+        cib_journal_compact();
     }
 
     mainloop_trigger_complete(cib_writer);
@@ -440,6 +921,7 @@ write_cib_contents(gpointer p)
     if (p) {
         /* Synchronous write out */
         cib_local = copy_xml(p);
+        cib_file_journal_version(p, journal_snapshot);
 
     } else {
         int pid = 0;
@@ -453,6 +935,9 @@ write_cib_contents(gpointer p)
          */
         qb_log_ctl(QB_LOG_BLACKBOX, QB_LOG_CONF_ENABLED, QB_FALSE);
 
+        /* Anything journalled after this is not part of what the child writes */
+        cib_file_journal_version(the_cib, journal_snapshot);
+
         pid = fork();
         if (pid < 0) {
             crm_perror(LOG_ERR, "Disabling disk writes after fork failure");
@@ -462,6 +947,7 @@ write_cib_contents(gpointer p)
 
         if (pid) {
             /* Parent */
+            writer_pid = pid;
             mainloop_child_add(pid, 0, "disk-writer", NULL, cib_diskwrite_complete);
             if (bb_state == QB_LOG_STATE_ENABLED) {
                 /* Re-enable now that it it safe */
@@ -484,9 +970,46 @@ write_cib_contents(gpointer p)
 
     /* A nonzero exit code will cause further writes to be disabled */
     free_xml(cib_local);
-    if (p == NULL) {
+    if (p && exit_rc == pcmk_ok) {
+        cib_journal_compact();
+
+    } else if (p == NULL) {
         /* Use _exit() because exit() could affect the parent adversely */
         _exit(exit_rc);
     }
     return exit_rc;
 }
+
+/*!
+ * \internal
+ * \brief Write out any journalled changes before exiting
+ *
+ * Not every reader of cib.xml replays the journal (crm_verify -x and
+ * crm_report don't), so leave it empty after a clean shutdown.
+ */
+void
+cib_journal_flush(void)
+{
+    /* Whatever happens next, don't leave anything unsynced */
+    if (journal_sync_timer) {
+        mainloop_timer_del(journal_sync_timer);
+        journal_sync_timer = NULL;
+        cib_journal_sync(NULL);
+    }
+
+    if ((the_cib == NULL) || (journal_records == 0)
+        || (cib_writes_enabled == FALSE) || (cib_status != pcmk_ok)) {
+        return;
+    }
+
+    if (writer_pid > 0) {
+        /* Don't let it replace our newer copy once it finishes */
+        crm_debug("Waiting for disk writer %d before exiting", writer_pid);
+        waitpid(writer_pid, NULL, 0);
+        writer_pid = 0;
+    }
+
+    crm_info("Writing %d journalled change%s to disk before exiting",
+             journal_records, (journal_records == 1)? "" : "s");
+    write_cib_contents(the_cib);
+}
@@ -43,6 +43,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include "common.h"
+#include "cache.h"
 
 #if HAVE_LIBXML2
 #  include <libxml/parser.h>
@@ -258,6 +259,8 @@ main(int argc, char **argv)
 void
 cib_cleanup(void)
 {
+    cib_snapshot_remove();
+    cib_query_cache_cleanup();
     crm_peer_destroy();
     if (local_notify_queue) {
         g_hash_table_destroy(local_notify_queue);
@@ -557,7 +560,7 @@ startCib(const char *filename)
 
     CRM_ASSERT(cib != NULL);
 
-    if (activateCibXml(cib, TRUE, "start") == 0) {
+    if (activateCibXml(cib, TRUE, "start", NULL) == 0) {
         int port = 0;
         const char *port_s = NULL;
 
@@ -33,6 +33,7 @@
 #include <crm/msg_xml.h>
 
 #include <crm/common/xml.h>
+#include <crm/common/xml_internal.h>
 #include <crm/common/ipcs.h>
 #include <crm/cluster/internal.h>
 
@@ -43,6 +44,12 @@
 /* Maximum number of diffs to ignore while waiting for a resync */
 #define MAX_DIFF_RETRY 5
 
+/* Number of recent patchsets kept for catching up lagging peers */
+#define CIB_DIFF_RING_SIZE 64
+
+/* Oldest feature set that understands CIB_OP_SYNC_DELTA */
+#define CIB_DELTA_SYNC_VERSION "3.0.16"
+
 gboolean cib_is_master = FALSE;
 
 xmlNode *the_cib = NULL;
@@ -167,29 +174,216 @@ cib_process_readwrite(const char *op, int options, const char *section, xmlNode
  */
 static int sync_in_progress = 0;
 
+typedef struct cib_diff_ring_entry_s {
+    int source[3];
+    int target[3];
+    xmlNode *patchset;
+} cib_diff_ring_entry_t;
+
+/* Recently applied v2 patchsets, oldest overwritten first */
+static cib_diff_ring_entry_t diff_ring[CIB_DIFF_RING_SIZE];
+static int diff_ring_next = 0;
+
+/*!
+ * \internal
+ * \brief Forget all patchset history
+ *
+ * Called when the_cib is replaced wholesale, since peers can then no longer
+ * be caught up by replaying the patchsets that led to the old copy.
+ */
 void
-send_sync_request(const char *host)
+cib_diff_ring_clear(void)
+{
+    int lpc = 0;
+
+    for (lpc = 0; lpc < CIB_DIFF_RING_SIZE; lpc++) {
+        free_xml(diff_ring[lpc].patchset);
+        diff_ring[lpc].patchset = NULL;
+    }
+    diff_ring_next = 0;
+}
+
+/*!
+ * \internal
+ * \brief Remember a patchset that was just applied to the_cib
+ *
+ * \param[in] patchset  Changes made by the last successful CIB operation
+ */
+void
+cib_diff_ring_add(xmlNode * patchset)
+{
+    int format = 1;
+    cib_diff_ring_entry_t *entry = NULL;
+
+    if (patchset == NULL) {
+        /* Nothing changed */
+        return;
+    }
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        /* The history can no longer be replayed without a gap */
+        cib_diff_ring_clear();
+        return;
+    }
+
+    entry = &diff_ring[diff_ring_next];
+    free_xml(entry->patchset);
+    entry->patchset = NULL;
+
+    cib_diff_version_details(patchset,
+                             &entry->target[0], &entry->target[1], &entry->target[2],
+                             &entry->source[0], &entry->source[1], &entry->source[2]);
+
+    if (memcmp(entry->source, entry->target, sizeof(entry->source)) != 0) {
+        entry->patchset = copy_xml(patchset);
+        diff_ring_next = (diff_ring_next + 1) % CIB_DIFF_RING_SIZE;
+    }
+}
+
+static cib_diff_ring_entry_t *
+cib_diff_ring_find(const int *source)
+{
+    int lpc = 0;
+
+    for (lpc = 0; lpc < CIB_DIFF_RING_SIZE; lpc++) {
+        if (diff_ring[lpc].patchset
+            && memcmp(diff_ring[lpc].source, source, sizeof(diff_ring[lpc].source)) == 0) {
+            return &diff_ring[lpc];
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Collect the patchsets needed to bring a peer up to our version
+ *
+ * \param[in]  peer_version  Admin epoch, epoch and num_updates of the peer
+ * \param[out] steps         Number of patchsets collected
+ *
+ * \return Patchsets to apply in order, or NULL if a full sync is needed
+ */
+static xmlNode *
+cib_diff_ring_delta(const int *peer_version, int *steps)
+{
+    int version[3];
+    int current[3] = { 0, 0, 0 };
+    xmlNode *delta = NULL;
+
+    crm_element_value_int(the_cib, XML_ATTR_GENERATION_ADMIN, &current[0]);
+    crm_element_value_int(the_cib, XML_ATTR_GENERATION, &current[1]);
+    crm_element_value_int(the_cib, XML_ATTR_NUMUPDATES, &current[2]);
+    memcpy(version, peer_version, sizeof(version));
+
+    while (memcmp(version, current, sizeof(version)) != 0) {
+        cib_diff_ring_entry_t *entry = cib_diff_ring_find(version);
+
+        if (entry == NULL || *steps >= CIB_DIFF_RING_SIZE) {
+            crm_debug("No patchset history from %d.%d.%d to %d.%d.%d",
+                      peer_version[0], peer_version[1], peer_version[2],
+                      current[0], current[1], current[2]);
+            free_xml(delta);
+            return NULL;
+        }
+
+        if (delta == NULL) {
+            delta = create_xml_node(NULL, CIB_OP_SYNC_DELTA);
+        }
+        add_node_copy(delta, entry->patchset);
+        memcpy(version, entry->target, sizeof(version));
+        (*steps)++;
+    }
+    return delta;
+}
+
+/*!
+ * \internal
+ * \brief Get the CIB version a sync requester had, if it can take a delta
+ *
+ * \param[in]  request      Sync request, or reply to our ping
+ * \param[out] version      Peer's CIB version
+ * \param[out] feature_set  Peer's feature set
+ *
+ * \return TRUE if the peer supports delta syncs and its version is known
+ */
+static gboolean
+sync_peer_version(xmlNode * request, int *version, const char **feature_set)
+{
+    xmlNode *peer_cib = request;
+
+    *feature_set = crm_element_value(request, XML_ATTR_CRM_VERSION);
+    if (*feature_set == NULL) {
+        /* Ping replies carry the details in the pong, with the version
+         * in the (shallow) copy of the peer's CIB attached to that
+         */
+        xmlNode *pong = get_message_xml(request, F_CIB_CALLDATA);
+
+        if (pong == NULL) {
+            return FALSE;
+        }
+        *feature_set = crm_element_value(pong, XML_ATTR_CRM_VERSION);
+        peer_cib = get_message_xml(pong, F_CIB_CALLDATA);
+    }
+
+    if (*feature_set == NULL || compare_version(*feature_set, CIB_DELTA_SYNC_VERSION) < 0) {
+        return FALSE;
+    }
+
+    return (peer_cib != NULL)
+           && (crm_element_value_int(peer_cib, XML_ATTR_GENERATION_ADMIN, &version[0]) == 0)
+           && (crm_element_value_int(peer_cib, XML_ATTR_GENERATION, &version[1]) == 0)
+           && (crm_element_value_int(peer_cib, XML_ATTR_NUMUPDATES, &version[2]) == 0);
+}
+
+static void
+request_sync(const char *host, gboolean allow_delta)
 {
     xmlNode *sync_me = create_xml_node(NULL, "sync-me");
 
-    crm_info("Requesting re-sync from %s", (host? host : "all peers"));
+    crm_info("Requesting %sre-sync from %s",
+             (allow_delta? "" : "full "), (host? host : "all peers"));
     sync_in_progress = 1;
 
     crm_xml_add(sync_me, F_TYPE, "cib");
     crm_xml_add(sync_me, F_CIB_OPERATION, CIB_OP_SYNC_ONE);
     crm_xml_add(sync_me, F_CIB_DELEGATED, cib_our_uname);
 
+    if (allow_delta && the_cib) {
+        /* Let the peer send only what we're missing, if it still has it */
+        crm_xml_add(sync_me, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
+        crm_xml_add(sync_me, XML_ATTR_GENERATION_ADMIN,
+                    crm_element_value(the_cib, XML_ATTR_GENERATION_ADMIN));
+        crm_xml_add(sync_me, XML_ATTR_GENERATION,
+                    crm_element_value(the_cib, XML_ATTR_GENERATION));
+        crm_xml_add(sync_me, XML_ATTR_NUMUPDATES,
+                    crm_element_value(the_cib, XML_ATTR_NUMUPDATES));
+    }
+
     send_cluster_message(host ? crm_get_peer(0, host) : NULL, crm_msg_cib, sync_me, FALSE);
     free_xml(sync_me);
 }
 
+void
+send_sync_request(const char *host)
+{
+    request_sync(host, TRUE);
+}
+
 int
 cib_process_ping(const char *op, int options, const char *section, xmlNode * req, xmlNode * input,
                  xmlNode * existing_cib, xmlNode ** result_cib, xmlNode ** answer)
 {
     const char *host = crm_element_value(req, F_ORIG);
     const char *seq = crm_element_value(req, F_CIB_PING_ID);
-    char *digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE, CRM_FEATURE_SET);
+    const char *version = crm_element_value(req, XML_ATTR_CRM_VERSION);
+    char *digest = NULL;
+
+    /* Use the newest digest format that both we and the requester support */
+    if (version == NULL || compare_version(version, CRM_FEATURE_SET) > 0) {
+        version = CRM_FEATURE_SET;
+    }
+    digest = calculate_cib_peer_digest(the_cib, version);
 
     static struct qb_log_callsite *cs = NULL;
 
@@ -303,6 +497,56 @@ cib_process_sync_one(const char *op, int options, const char *section, xmlNode *
     return sync_our_cib(req, FALSE);
 }
 
+int
+cib_process_sync_delta(const char *op, int options, const char *section, xmlNode * req,
+                       xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
+                       xmlNode ** answer)
+{
+    int rc = pcmk_ok;
+    int applied = 0;
+    xmlNode *patchset = NULL;
+    const char *host = crm_element_value(req, F_ORIG);
+    const char *digest = crm_element_value(req, XML_ATTR_DIGEST);
+    const char *version = crm_element_value(req, XML_ATTR_CRM_VERSION);
+
+    CRM_CHECK(input != NULL && result_cib != NULL && *result_cib != NULL, return -EINVAL);
+
+    for (patchset = __xml_first_child_element(input); patchset != NULL && rc == pcmk_ok;
+         patchset = __xml_next_element(patchset)) {
+
+        rc = xml_apply_patchset(*result_cib, patchset, TRUE);
+        if (rc == pcmk_ok) {
+            applied++;
+        }
+    }
+
+    if (rc == pcmk_ok && digest != NULL) {
+        /* The patchsets applied, but make sure they got us an identical copy */
+        char *local_digest = calculate_cib_peer_digest(*result_cib, version);
+
+        if (safe_str_neq(local_digest, digest)) {
+            crm_warn("Catching up with %s produced digest %s instead of %s, "
+                     "requesting full resync", host, local_digest, digest);
+            rc = -pcmk_err_diff_failed;
+            request_sync(host, FALSE);
+        }
+        free(local_digest);
+
+    } else if (rc != pcmk_ok) {
+        /* Our history has diverged, so asking for a delta again won't help */
+        crm_warn("Could not apply patchset %d from %s, requesting full resync: %s "
+                 CRM_XS " rc=%d", applied + 1, host, pcmk_strerror(rc), rc);
+        request_sync(host, FALSE);
+    }
+
+    if (rc == pcmk_ok) {
+        crm_info("Caught up with %s using %d patchset%s",
+                 host, applied, (applied == 1)? "" : "s");
+        sync_in_progress = 0;
+    }
+    return rc;
+}
+
 int
 cib_server_process_diff(const char *op, int options, const char *section, xmlNode * req,
                         xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
@@ -494,6 +738,62 @@ check_generation(xmlNode * newCib, xmlNode * oldCib)
     return FALSE;
 }
 
+/*!
+ * \internal
+ * \brief Send a lagging peer just the patchsets it is missing
+ *
+ * \return TRUE if a delta was sent, FALSE if a full sync is needed
+ */
+static gboolean
+sync_our_cib_delta(xmlNode * request, const char *host)
+{
+    int steps = 0;
+    int peer_version[3] = { 0, 0, 0 };
+    char *digest = NULL;
+    const char *feature_set = NULL;
+    gboolean sent = FALSE;
+    xmlNode *delta = NULL;
+    xmlNode *delta_request = NULL;
+
+    if (cib_legacy_mode() || sync_peer_version(request, peer_version, &feature_set) == FALSE) {
+        return FALSE;
+    }
+
+    delta = cib_diff_ring_delta(peer_version, &steps);
+    if (delta == NULL) {
+        return FALSE;
+    }
+
+    crm_info("Syncing CIB to %s using %d patchset%s from %d.%d.%d",
+             host, steps, (steps == 1)? "" : "s",
+             peer_version[0], peer_version[1], peer_version[2]);
+
+    delta_request = cib_msg_copy(request, FALSE);
+    crm_xml_add(delta_request, F_CIB_ISREPLY, host);
+    crm_xml_add(delta_request, F_CIB_OPERATION, CIB_OP_SYNC_DELTA);
+    crm_xml_add(delta_request, "original_" F_CIB_OPERATION,
+                crm_element_value(request, F_CIB_OPERATION));
+    crm_xml_add(delta_request, F_CIB_GLOBAL_UPDATE, XML_BOOLEAN_TRUE);
+    add_message_xml(delta_request, F_CIB_CALLDATA, delta);
+
+    /* Let the peer verify it ends up with exactly our copy, using the newest
+     * digest format that both of us support
+     */
+    if (compare_version(feature_set, CRM_FEATURE_SET) > 0) {
+        feature_set = CRM_FEATURE_SET;
+    }
+    digest = calculate_cib_peer_digest(the_cib, feature_set);
+    crm_xml_add(delta_request, XML_ATTR_DIGEST, digest);
+    crm_xml_add(delta_request, XML_ATTR_CRM_VERSION, feature_set);
+    free(digest);
+
+    sent = send_cluster_message(crm_get_peer(0, host), crm_msg_cib, delta_request, FALSE);
+
+    free_xml(delta_request);
+    free_xml(delta);
+    return sent;
+}
+
 int
 sync_our_cib(xmlNode * request, gboolean all)
 {
@@ -502,9 +802,15 @@ sync_our_cib(xmlNode * request, gboolean all)
     const char *host = crm_element_value(request, F_ORIG);
     const char *op = crm_element_value(request, F_CIB_OPERATION);
 
-    xmlNode *replace_request = cib_msg_copy(request, FALSE);
+    xmlNode *replace_request = NULL;
 
     CRM_CHECK(the_cib != NULL,;);
+
+    if (all == FALSE && host != NULL && sync_our_cib_delta(request, host)) {
+        return pcmk_ok;
+    }
+
+    replace_request = cib_msg_copy(request, FALSE);
     CRM_CHECK(replace_request != NULL,;);
 
     crm_debug("Syncing CIB to %s", all ? "all peers" : host);
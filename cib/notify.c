@@ -37,6 +37,7 @@
 #include <cibio.h>
 #include <callbacks.h>
 #include <notify.h>
+#include "common.h"
 
 int pending_updates = 0;
 
@@ -44,8 +45,18 @@ struct cib_notification_s {
     xmlNode *msg;
     struct iovec *iov;
     int32_t iov_size;
+    crm_ipc_published_t *published;
 };
 
+/* Client ID -> list of patchset paths that the client wants diffs for */
+static GHashTable *diff_filters = NULL;
+
+/* Merged patchsets bigger than this are replaced by a resync request */
+#define CIB_NOTIFY_MERGE_MAX 5000
+
+static unsigned long diffs_merged = 0;
+static unsigned long diffs_resynced = 0;
+
 void attach_cib_generation(xmlNode * msg, const char *field, xmlNode * a_cib);
 
 void do_cib_notify(int options, const char *op, xmlNode * update,
@@ -75,6 +86,331 @@ need_post_notify(gpointer key, gpointer value, gpointer user_data)
     }
 }
 
+/*!
+ * \internal
+ * \brief Add or remove a diff notification filter for a client
+ *
+ * \param[in] client   Client to update
+ * \param[in] filter   CIB section name, or absolute path in patchset
+ *                     notation (e.g. "/cib/status/node_state[@id='1']")
+ * \param[in] enabled  Whether to add or remove \p filter
+ *
+ * \return pcmk_ok on success, -EINVAL if \p filter is not a section name
+ *         or plain patchset path
+ */
+int
+cib_notify_filter_diffs(crm_client_t *client, const char *filter, gboolean enabled)
+{
+    char *path = NULL;
+    GList *filters = NULL;
+    GList *existing = NULL;
+
+    CRM_CHECK(client != NULL && filter != NULL, return -EINVAL);
+
+    path = cib_diff_filter_path(filter);
+    if (path == NULL) {
+        crm_warn("Rejecting invalid diff filter %s from %s",
+                 filter, crm_client_name(client));
+        return -EINVAL;
+    }
+
+    if (diff_filters == NULL) {
+        diff_filters = g_hash_table_new_full(crm_str_hash, g_str_equal, free, NULL);
+    }
+
+    filters = g_hash_table_lookup(diff_filters, client->id);
+    existing = g_list_find_custom(filters, path, (GCompareFunc) strcmp);
+
+    if (enabled && existing == NULL) {
+        filters = g_list_prepend(filters, path);
+        path = NULL;
+
+    } else if (enabled == FALSE && existing != NULL) {
+        free(existing->data);
+        filters = g_list_delete_link(filters, existing);
+    }
+
+    if (filters) {
+        g_hash_table_replace(diff_filters, strdup(client->id), filters);
+    } else {
+        g_hash_table_remove(diff_filters, client->id);
+    }
+
+    crm_debug("Client %s now has %d diff filter%s",
+              crm_client_name(client), g_list_length(filters),
+              (g_list_length(filters) == 1)? "" : "s");
+    free(path);
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Forget all diff notification filters of a client
+ */
+void
+cib_notify_filter_clear(crm_client_t *client)
+{
+    GList *filters = NULL;
+
+    if (diff_filters && client && client->id) {
+        filters = g_hash_table_lookup(diff_filters, client->id);
+        g_hash_table_remove(diff_filters, client->id);
+        g_list_free_full(filters, free);
+    }
+}
+
+static gboolean
+diff_change_matches(xmlNode *change, GList *filters)
+{
+    GList *gIter = NULL;
+    gboolean matches = FALSE;
+    char *path = cib_change_path(change);
+
+    if (path == NULL) {
+        return TRUE;
+    }
+
+    for (gIter = filters; gIter != NULL && matches == FALSE; gIter = gIter->next) {
+        matches = cib_path_overlaps(path, gIter->data);
+    }
+
+    free(path);
+    return matches;
+}
+
+/*!
+ * \internal
+ * \brief Create a copy of a diff notification with only the parts a client wants
+ *
+ * \return Filtered notification, or NULL if nothing in it is relevant
+ */
+static xmlNode *
+diff_notification_filter(xmlNode *msg, GList *filters)
+{
+    int format = 1;
+    int relevant = 0;
+    int dropped = 0;
+    xmlNode *copy = NULL;
+    xmlNode *patchset = NULL;
+    xmlNode *change = NULL;
+
+    patchset = get_message_xml(msg, F_CIB_UPDATE_RESULT);
+    if (patchset == NULL) {
+        return copy_xml(msg);
+    }
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        /* Only v2 patchsets can be narrowed down by path */
+        return copy_xml(msg);
+    }
+
+    copy = copy_xml(msg);
+    patchset = get_message_xml(copy, F_CIB_UPDATE_RESULT);
+
+    change = __xml_first_child(patchset);
+    while (change != NULL) {
+        xmlNode *next = __xml_next(change);
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+        if (safe_str_neq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            /* Version details */
+
+        } else if (safe_str_eq(path, "/" XML_TAG_CIB)
+                   && safe_str_eq(crm_element_value(change, XML_DIFF_OP), "modify")) {
+            /* Keep the version change, but it alone isn't worth sending */
+
+        } else if (diff_change_matches(change, filters)) {
+            relevant++;
+
+        } else {
+            free_xml(change);
+            dropped++;
+        }
+        change = next;
+    }
+
+    if (relevant == 0) {
+        free_xml(copy);
+        return NULL;
+
+    } else if (dropped) {
+        /* The digest is of the full result, which a narrowed patchset no
+         * longer leads to, so applying it would look like a failure
+         */
+        xml_remove_prop(patchset, XML_ATTR_DIGEST);
+    }
+    return copy;
+}
+
+/*!
+ * \internal
+ * \brief Replace a diff notification's patchset with one that forces a resync
+ *
+ * The patchset is empty and goes from the notification's target version to
+ * itself, so a client that is behind cannot apply it and re-reads the CIB.
+ */
+static xmlNode *
+diff_notification_resync(xmlNode *msg)
+{
+    int lpc = 0;
+    int add[] = { 0, 0, 0 };
+    int del[] = { 0, 0, 0 };
+    xmlNode *copy = copy_xml(msg);
+    xmlNode *patchset = get_message_xml(copy, F_CIB_UPDATE_RESULT);
+    xmlNode *version = NULL;
+    xmlNode *source = NULL;
+    xmlNode *target = NULL;
+
+    const char *vfields[] = {
+        XML_ATTR_GENERATION_ADMIN,
+        XML_ATTR_GENERATION,
+        XML_ATTR_NUMUPDATES,
+    };
+
+    if (patchset) {
+        xml_patch_versions(patchset, add, del);
+    }
+    free_xml(find_xml_node(copy, F_CIB_UPDATE_RESULT, FALSE));
+
+    patchset = create_xml_node(NULL, XML_TAG_DIFF);
+    crm_xml_add_int(patchset, "format", 2);
+    version = create_xml_node(patchset, XML_DIFF_VERSION);
+    source = create_xml_node(version, XML_DIFF_VSOURCE);
+    target = create_xml_node(version, XML_DIFF_VTARGET);
+    for (lpc = 0; lpc < DIMOF(vfields); lpc++) {
+        crm_xml_add_int(source, vfields[lpc], add[lpc]);
+        crm_xml_add_int(target, vfields[lpc], add[lpc]);
+    }
+
+    add_message_xml(copy, F_CIB_UPDATE_RESULT, patchset);
+    free_xml(patchset);
+
+    diffs_resynced++;
+    return copy;
+}
+
+/*!
+ * \internal
+ * \brief Merge a diff notification into one held for a lagging client
+ *
+ * Consecutive v2 patchsets are combined by applying all their changes in
+ * order from the first source version to the last target version. Anything
+ * that can't be combined that way becomes a request to resync.
+ *
+ * \param[in] held  Notification already held for the client (may be NULL)
+ * \param[in] msg   New diff notification
+ *
+ * \return Newly allocated notification to hold instead of both
+ */
+static xmlNode *
+diff_notification_merge(xmlNode *held, xmlNode *msg)
+{
+    int lpc = 0;
+    int changes = 0;
+    int format = 1;
+    int held_format = 1;
+    int add[] = { 0, 0, 0 };
+    int del[] = { 0, 0, 0 };
+    int held_add[] = { 0, 0, 0 };
+    int held_del[] = { 0, 0, 0 };
+    const char *digest = NULL;
+    xmlNode *merged = NULL;
+    xmlNode *patchset = NULL;
+    xmlNode *held_patchset = NULL;
+    xmlNode *change = NULL;
+    xmlNode *target = NULL;
+
+    const char *vfields[] = {
+        XML_ATTR_GENERATION_ADMIN,
+        XML_ATTR_GENERATION,
+        XML_ATTR_NUMUPDATES,
+    };
+
+    if (held == NULL) {
+        return copy_xml(msg);
+    }
+
+    held_patchset = get_message_xml(held, F_CIB_UPDATE_RESULT);
+    patchset = get_message_xml(msg, F_CIB_UPDATE_RESULT);
+    if (held_patchset == NULL || patchset == NULL) {
+        return diff_notification_resync(msg);
+    }
+
+    crm_element_value_int(held_patchset, "format", &held_format);
+    crm_element_value_int(patchset, "format", &format);
+    if (held_format != 2 || format != 2) {
+        crm_trace("Can't merge v%d patchset into v%d", format, held_format);
+        return diff_notification_resync(msg);
+    }
+
+    xml_patch_versions(held_patchset, held_add, held_del);
+    xml_patch_versions(patchset, add, del);
+    for (lpc = 0; lpc < DIMOF(vfields); lpc++) {
+        if (held_add[lpc] != del[lpc]) {
+            crm_trace("Can't merge non-consecutive patchsets (%d.%d.%d vs %d.%d.%d)",
+                      held_add[0], held_add[1], held_add[2], del[0], del[1], del[2]);
+            return diff_notification_resync(msg);
+        }
+    }
+
+    /* Start from the held changes, then add the new ones */
+    held_patchset = copy_xml(held_patchset);
+    for (change = __xml_first_child(held_patchset); change != NULL; change = __xml_next(change)) {
+        changes++;
+    }
+    for (change = __xml_first_child(patchset); change != NULL; change = __xml_next(change)) {
+        if (safe_str_eq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            add_node_copy(held_patchset, change);
+            changes++;
+        }
+    }
+    if (changes > CIB_NOTIFY_MERGE_MAX) {
+        free_xml(held_patchset);
+        return diff_notification_resync(msg);
+    }
+
+    target = find_xml_node(find_xml_node(held_patchset, XML_DIFF_VERSION, FALSE),
+                           XML_DIFF_VTARGET, FALSE);
+    for (lpc = 0; target && lpc < DIMOF(vfields); lpc++) {
+        crm_xml_add_int(target, vfields[lpc], add[lpc]);
+    }
+
+    /* The digest describes the result, which is that of the last patchset */
+    digest = crm_element_value(patchset, XML_ATTR_DIGEST);
+    if (digest) {
+        crm_xml_add(held_patchset, XML_ATTR_DIGEST, digest);
+    } else {
+        xml_remove_prop(held_patchset, XML_ATTR_DIGEST);
+    }
+
+    /* Everything else comes from the newest notification */
+    merged = copy_xml(msg);
+    free_xml(find_xml_node(merged, F_CIB_UPDATE_RESULT, FALSE));
+    add_message_xml(merged, F_CIB_UPDATE_RESULT, held_patchset);
+    free_xml(held_patchset);
+
+    diffs_merged++;
+    if ((diffs_merged % 1000) == 0) {
+        crm_debug("Diff notifications for lagging clients: %lu merged, %lu resyncs",
+                  diffs_merged, diffs_resynced);
+    }
+    return merged;
+}
+
+/*!
+ * \internal
+ * \brief Check whether diff notifications for a client should be merged
+ *
+ * Other daemons (the crmd in particular) act on each diff's changes and
+ * don't re-read the CIB when a merge degrades to a resync, so they always
+ * get every diff; they have a raised eviction threshold instead.
+ */
+static gboolean
+diff_client_mergeable(crm_client_t *client)
+{
+    return is_not_set(client->options, cib_is_daemon) && crm_ipcs_client_lagging(client);
+}
+
 static gboolean
 cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
 {
@@ -113,10 +449,42 @@ cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
         do_send = TRUE;
     }
 
+    if (do_send && diff_filters && safe_str_eq(type, T_CIB_DIFF_NOTIFY)) {
+        GList *filters = g_hash_table_lookup(diff_filters, client->id);
+
+        if (filters) {
+            xmlNode *filtered = diff_notification_filter(update->msg, filters);
+
+            if (filtered == NULL) {
+                crm_trace("Nothing in %s notification for client %s/%s",
+                          type, client->name, client->id);
+
+            } else if (client->kind == CRM_CLIENT_IPC && diff_client_mergeable(client)) {
+                crm_ipcs_hold_event(client, filtered, diff_notification_merge);
+
+            } else if (client->kind == CRM_CLIENT_IPC) {
+                if (crm_ipcs_send(client, 0, filtered, crm_ipc_server_event) < 0) {
+                    crm_warn("Notification of client %s/%s failed", client->name, client->id);
+                }
+
+            } else if (client->remote) {
+                crm_remote_send(client->remote, filtered);
+            }
+
+            free_xml(filtered);
+            return FALSE;
+        }
+    }
+
     if (do_send) {
         switch (client->kind) {
             case CRM_CLIENT_IPC:
-                if (crm_ipcs_sendv(client, update->iov, crm_ipc_server_event) < 0) {
+                if (safe_str_eq(type, T_CIB_DIFF_NOTIFY) && diff_client_mergeable(client)) {
+                    /* Merge diffs rather than let a slow client be evicted */
+                    crm_ipcs_hold_event(client, update->msg, diff_notification_merge);
+
+                } else if (crm_ipcs_sendv_published(client, update->iov, update->published,
+                                                    crm_ipc_server_event) < 0) {
                     crm_warn("Notification of client %s/%s failed", client->name, client->id);
                 }
                 break;
@@ -148,7 +516,11 @@ cib_notify_send(xmlNode * xml)
         update.msg = xml;
         update.iov = iov;
         update.iov_size = rc;
+
+        /* Large notifications are copied once for all local clients */
+        update.published = crm_ipcs_publish(iov);
         g_hash_table_foreach_remove(client_connections, cib_notify_send_one, &update);
+        crm_ipcs_unpublish(update.published);
 
     } else {
         crm_notice("Notification failed: %s (%d)", pcmk_strerror(rc), rc);
@@ -23,6 +23,7 @@
 
 #include <crm/crm.h>
 #include <crm/common/xml.h>
+#include <crm/common/ipcs.h>
 
 extern FILE *msg_cib_strm;
 
@@ -35,3 +36,7 @@ extern void cib_diff_notify(int options, const char *client, const char *call_id
                             xmlNode * update, int result, xmlNode * old_cib);
 
 extern void cib_replace_notify(const char *origin, xmlNode * update, int result, xmlNode * diff);
+
+extern int cib_notify_filter_diffs(crm_client_t *client, const char *filter,
+                                   gboolean enabled);
+extern void cib_notify_filter_clear(crm_client_t *client);
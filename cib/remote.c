@@ -40,6 +40,7 @@
 #include <crm/cib/internal.h>
 
 #include "callbacks.h"
+#include "notify.h"
 /* #undef HAVE_PAM_PAM_APPL_H */
 /* #undef HAVE_GNUTLS_GNUTLS_H */
 
@@ -395,6 +396,7 @@ cib_remote_connection_destroy(gpointer user_data)
         close(csock);
     }
 
+    cib_notify_filter_clear(client);
     crm_client_destroy(client);
 
     crm_trace("Freed the cib client");
@@ -1835,6 +1835,81 @@ class Reattach(CTSTest):
 AllTestClasses.append(Reattach)
 
 
+class CIBDeltaSync(CTSTest):
+    '''Check that the DC's digest pings catch peers up with just the changes they missed'''
+    def __init__(self, cm):
+        CTSTest.__init__(self,cm)
+        self.name = "CIBDeltaSync"
+        self.startall = SimulStartLite(cm)
+
+    def __call__(self, node):
+        '''Perform the 'CIBDeltaSync' test. '''
+        self.incr("calls")
+
+        ret = self.startall(None)
+        if not ret:
+            return self.failure("Setup failed")
+
+        if not self.CM.cluster_stable(self.Env["StableTime"]):
+            return self.failure("Setup failed - unstable")
+
+        dc = None
+        for other in self.Env["nodes"]:
+            if self.CM.is_node_dc(other):
+                dc = other
+                break
+        if not dc:
+            return self.failure("Could not find the DC")
+
+        # Bumping the epoch without broadcasting it leaves every peer one
+        # change behind, which the next ping (and its replies) should notice
+        peers = [other for other in self.Env["nodes"] if other != dc]
+        pats = []
+        for peer in peers:
+            pats.append(r"%s\W.*cib.*Local CIB .* differs from %s" % (dc, peer))
+            pats.append(r"%s\W.*cib.*Syncing CIB to %s using 1 patchset" % (dc, peer))
+
+        watch = self.create_watch(pats, 60)
+        watch.setwatch()
+
+        self.rsh(dc, "cibadmin --bump --no-bcast")
+
+        watch.lookforall()
+        if watch.unmatched:
+            return self.failure("Patterns not found: " + repr(watch.unmatched))
+
+        if not self.CM.cluster_stable(self.Env["StableTime"]):
+            return self.failure("Unstable after delta sync")
+
+        expected = self.cib_version(dc)
+        for peer in peers:
+            if self.cib_version(peer) != expected:
+                return self.failure("%s did not catch up with %s" % (peer, dc))
+
+        return self.success()
+
+    def cib_version(self, node):
+        '''Return the configuration version (admin_epoch, epoch) of a node's CIB'''
+        line = self.rsh(node, "cibadmin -Q --local | head -1", 1) or ""
+        version = []
+        for attr in ("admin_epoch", "epoch"):
+            match = re.search(r'\s%s="(\d+)"' % attr, line)
+            version.append(match and match.group(1))
+        return version
+
+    def is_applicable(self):
+        # Legacy (plugin/heartbeat) clusters always sync the whole CIB
+        if self.Env["Stack"] != "corosync 2.x" or len(self.Env["nodes"]) < 2:
+            return False
+        return self.is_applicable_common()
+
+    def errorstoignore(self):
+        '''Return list of errors which should be ignored'''
+        return []
+
+AllTestClasses.append(CIBDeltaSync)
+
+
 class SpecialTest1(CTSTest):
     '''Set up a custom test to cause quorum failure issues for Andrew'''
     def __init__(self, cm):
@@ -1173,7 +1173,7 @@ stonith_cleanup(void)
     }
 
     if (ipcs) {
-        qb_ipcs_destroy(ipcs);
+        mainloop_del_ipc_server(ipcs);
     }
 
     g_hash_table_destroy(known_peer_names);
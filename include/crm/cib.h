@@ -143,6 +143,16 @@ typedef struct cib_api_operations_s {
                                                         xmlNode *, void *),
                                        void (*free_func)(void *));
 
+    int (*transaction) (cib_t * cib, xmlNode * transaction, int call_options);
+
+    /* Restrict T_CIB_DIFF_NOTIFY to changes at or below a section name or
+     * patchset path. Filtered clients are only sent the matching changes
+     * (plus the version update), so they cannot maintain a full CIB copy.
+     * Paths are plain prefixes, not XPath: -EINVAL is returned for anything
+     * but element names with optional [@id='...'] predicates.
+     */
+    int (*register_diff_filter) (cib_t * cib, const char *filter, int enabled);
+
 } cib_api_operations_t;
 
 struct cib_s {
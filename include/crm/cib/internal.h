@@ -17,6 +17,7 @@
  */
 #ifndef CIB_INTERNAL__H
 #  define CIB_INTERNAL__H
+#  include <stdint.h>
 #  include <crm/cib.h>
 #  include <crm/common/ipcs.h>
 
@@ -38,6 +39,8 @@
 #  define CIB_OP_UPGRADE    "cib_upgrade"
 #  define CIB_OP_UPGRADE_OK "cib_upgrade_ok"
 #  define CIB_OP_DELETE_ALT	"cib_delete_alt"
+#  define CIB_OP_TRANSACTION	"cib_transaction"
+#  define CIB_OP_SYNC_DELTA	"cib_sync_delta"
 #  define CIB_OP_NOTIFY	      "cib_notify"
 
 #  define F_CIB_CLIENTID  "cib_clientid"
@@ -62,6 +65,7 @@
 #  define F_CIB_CLIENTNAME	"cib_clientname"
 #  define F_CIB_NOTIFY_TYPE	"cib_notify_type"
 #  define F_CIB_NOTIFY_ACTIVATE	"cib_notify_activate"
+#  define F_CIB_NOTIFY_FILTER	"cib_notify_filter"
 #  define F_CIB_UPDATE_DIFF	"cib_update_diff"
 #  define F_CIB_USER		"cib_user"
 #  define F_CIB_LOCAL_NOTIFY_ID	"cib_local_notify_id"
@@ -90,6 +94,7 @@ int cib_compare_generation(xmlNode * left, xmlNode * right);
 gboolean cib_read_config(GHashTable * options, xmlNode * current_cib);
 void verify_cib_options(GHashTable * options);
 gboolean cib_internal_config_changed(xmlNode * diff);
+char *cib_diff_filter_path(const char *filter);
 
 extern GHashTable *cib_op_callback_table;
 typedef struct cib_notify_client_s {
@@ -127,6 +132,8 @@ int cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_
                    xmlNode * current_cib, xmlNode ** result_cib, xmlNode ** diff,
                    xmlNode ** output);
 
+gboolean cib_op_targets_status(const char *section, int call_options);
+
 xmlNode *cib_create_op(int call_id, const char *token, const char *op, const char *host,
                        const char *section, xmlNode * data, int call_options,
                        const char *user_name);
@@ -134,6 +141,7 @@ xmlNode *cib_create_op(int call_id, const char *token, const char *op, const cha
 void cib_native_callback(cib_t * cib, xmlNode * msg, int call_id, int rc);
 void cib_native_notify(gpointer data, gpointer user_data);
 int cib_native_register_notification(cib_t * cib, const char *callback, int enabled);
+int cib_native_register_diff_filter(cib_t * cib, const char *filter, int enabled);
 gboolean cib_client_register_callback(cib_t * cib, int call_id, int timeout, gboolean only_success,
                                       void *user_data, const char *callback_name,
                                       void (*callback) (xmlNode *, int, int, xmlNode *, void *));
@@ -181,6 +189,10 @@ int cib_process_upgrade(const char *op, int options, const char *section, xmlNod
                         xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
                         xmlNode ** answer);
 
+int cib_process_transaction(const char *op, int options, const char *section, xmlNode * req,
+                            xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
+                            xmlNode ** answer);
+
 /*!
  * \internal
  * \brief Core function to manipulate with/query CIB/XML per xpath + arguments
@@ -218,4 +230,45 @@ int cib_file_read_and_verify(const char *filename, const char *sigfile,
 int cib_file_write_with_digest(xmlNode *cib_root, const char *cib_dirname,
                                const char *cib_filename);
 
+/* The cib daemon appends configuration changes to this file, in the same
+ * directory as the live CIB, and only rewrites the CIB itself now and then.
+ * Each record is a "<length> <md5>" header line followed by an unformatted
+ * v2 patchset and a newline.
+ */
+#  define CIB_JOURNAL_FILE	"cib.journal"
+
+void cib_file_journal_version(xmlNode *cib, int *version);
+int cib_file_journal_version_cmp(const int *a, const int *b);
+xmlNode *cib_file_journal_next(const char *contents, size_t max, size_t *offset);
+size_t cib_file_journal_replay(xmlNode *root, const char *contents, size_t max,
+                               int *records, int *applied);
+
+/* The cib daemon publishes its current CIB here so that privileged local
+ * readers can query it without an IPC round trip.  Each snapshot file is
+ * replaced (never rewritten) and the daemon sets "stale" in the old one
+ * as soon as the CIB changes.  A new snapshot is only written once a
+ * reader has had to fall back to IPC.
+ */
+#  define CIB_SNAPSHOT_FILE	CRM_STATE_DIR "/cib.snapshot"
+#  define CIB_SNAPSHOT_MAGIC	0x42494350      /* "PCIB" */
+#  define CIB_SNAPSHOT_FORMAT	2
+
+typedef struct cib_snapshot_header_s {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t epoch;             /* Daemon's change counter when published */
+    volatile uint32_t stale;    /* Set once the CIB has changed */
+    uint32_t length;            /* Bytes of XML text that follow, including the terminator */
+    uint32_t pid;               /* Publishing daemon, which can't mark stale once gone */
+} cib_snapshot_header_t;
+
+/* A reader's parsed copy of the last snapshot it used */
+typedef struct cib_snapshot_s {
+    xmlNode *cib;
+    uint64_t epoch;
+    uint32_t pid;
+} cib_snapshot_t;
+
+xmlNode *cib_snapshot_read(cib_snapshot_t *cache);
+
 #endif
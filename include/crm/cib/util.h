@@ -67,4 +67,7 @@ void cib_metadata(void);
 const char *cib_pref(GHashTable * options, const char *name);
 int cib_apply_patch_event(xmlNode * event, xmlNode * input, xmlNode ** output, int level);
 
+xmlNode *cib_transaction_add(xmlNode * transaction, const char *op, const char *section,
+                             xmlNode * data, int call_options);
+
 #endif
@@ -69,8 +69,27 @@ gboolean crm_ends_with_ext(const char *s, const char *match);
 char *add_list_element(char *list, const char *value);
 bool crm_compress_string(const char *data, int length, int max, char **result,
                          unsigned int *result_len);
+
+enum crm_compression {
+    crm_compression_none = 0,
+    crm_compression_bz2  = 1,   /* Equal to TRUE, as older peers expect */
+    crm_compression_lz4  = 2,
+};
+
+const char *crm_compression_text(enum crm_compression codec);
+bool crm_compression_supported(enum crm_compression codec);
+bool crm_compress_string_as(enum crm_compression codec, const char *data, int length,
+                            int max, char **result, unsigned int *result_len);
+int crm_decompress_string(enum crm_compression codec, const char *data, unsigned int length,
+                          char *result, unsigned int *result_len);
 gint crm_alpha_sort(gconstpointer a, gconstpointer b);
 
+
+/* internal IPC functions (from ipc.c) */
+
+void crm_ipcs_bulk_init(void);
+void crm_ipcs_bulk_fini(void);
+
 static inline int
 crm_strlen_zero(const char *s)
 {
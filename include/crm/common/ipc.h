@@ -43,9 +43,18 @@ enum crm_ipc_flags
     crm_ipc_flags_none      = 0x00000000,
 
     crm_ipc_compressed      = 0x00000001, /* Message has been compressed */
+    crm_ipc_binary          = 0x00000002, /* Message uses the binary XML encoding */
+    crm_ipc_binary_ok       = 0x00000004, /* Sender can decode the binary XML encoding */
+    crm_ipc_lz4             = 0x00000008, /* Compressed with lz4 rather than bzip2 */
+    crm_ipc_lz4_ok          = 0x00000010, /* Sender can decompress lz4 */
+    crm_ipc_multipart       = 0x00000020, /* Message is one part of a larger one */
+    crm_ipc_multipart_end   = 0x00000040, /* Message is the last part of a larger one */
+    crm_ipc_multipart_ok    = 0x00000080, /* Sender can reassemble multipart replies and events */
 
     crm_ipc_proxied         = 0x00000100, /* _ALL_ replies to proxied connections need to be sent as events */
     crm_ipc_client_response = 0x00000200, /* A Response is expected in reply */
+    crm_ipc_bulk            = 0x00000400, /* Message is in (or was read from) a shared bulk area */
+    crm_ipc_bulk_ok         = 0x00000800, /* Sender can read from a shared bulk area */
 
     /* These options are just options for crm_ipcs_sendv() */
     crm_ipc_server_event    = 0x00010000, /* Send an Event instead of a Response */
@@ -68,6 +77,14 @@ void crm_ipc_destroy(crm_ipc_t * client);
 int crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags,
                  int32_t ms_timeout, xmlNode ** reply);
 
+/* Pipelined alternative to crm_ipc_send(): send several requests, then
+ * collect their replies by ID
+ */
+int crm_ipc_send_request(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags,
+                         int32_t ms_timeout, uint32_t * request_id);
+int crm_ipc_get_reply(crm_ipc_t * client, uint32_t request_id, int32_t ms_timeout,
+                      xmlNode ** reply);
+
 int crm_ipc_get_fd(crm_ipc_t * client);
 bool crm_ipc_connected(crm_ipc_t * client);
 int crm_ipc_ready(crm_ipc_t * client);
@@ -63,6 +63,10 @@ enum crm_client_flags
 {
     crm_client_flag_ipc_proxied    = 0x00001, /* ipc_proxy code only */
     crm_client_flag_ipc_privileged = 0x00002, /* root or cluster user */
+    crm_client_flag_ipc_binary     = 0x00004, /* Client can decode binary XML replies */
+    crm_client_flag_ipc_lz4        = 0x00008, /* Client can decompress lz4 */
+    crm_client_flag_ipc_multipart  = 0x00010, /* Client can reassemble multipart messages */
+    crm_client_flag_ipc_bulk       = 0x00020, /* Client can read from the shared bulk area */
 };
 
 struct crm_client_s {
@@ -85,6 +89,7 @@ struct crm_client_s {
 
     int event_timer;
     GList *event_queue; /* @TODO use GQueue instead */
+    GList *reply_queue; /* Responses waiting for room in the client's buffer */
 
     /* Depending on the value of kind, only some of the following
      * will be populated/valid
@@ -97,8 +102,20 @@ struct crm_client_s {
 
     unsigned int queue_backlog; /* IPC queue length after last flush */
     unsigned int queue_max;     /* Evict client whose queue grows this big */
+    unsigned int queue_peak;    /* Longest IPC queue seen */
+
+    GList *held_events;         /* Events to send (in order) once client catches up */
+    unsigned int events_held;   /* Events held, before merging */
+    unsigned int events_merged; /* Events merged over the connection's lifetime */
+
+    unsigned int bulk_consumer; /* Position in shared bulk area's consumers (1-based) */
 };
 
+/* Combine a new event with the one being held for a lagging client,
+ * returning a newly allocated replacement for both (held may be NULL)
+ */
+typedef xmlNode *(*crm_ipcs_merge_fn)(xmlNode *held, xmlNode *event);
+
 extern GHashTable *client_connections;
 
 void crm_client_init(void);
@@ -113,6 +130,8 @@ crm_client_t *crm_client_new(qb_ipcs_connection_t * c, uid_t uid, gid_t gid);
 void crm_client_destroy(crm_client_t * c);
 void crm_client_disconnect_all(qb_ipcs_service_t *s);
 bool crm_set_client_queue_max(crm_client_t *client, const char *qmax);
+bool crm_ipcs_client_lagging(crm_client_t *c);
+void crm_ipcs_hold_event(crm_client_t *c, xmlNode *event, crm_ipcs_merge_fn merge);
 
 void crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags,
                        const char *tag, const char *function, int line);
@@ -121,6 +140,16 @@ void crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags,
 ssize_t crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size);
 ssize_t crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message, enum crm_ipc_flags flags);
 ssize_t crm_ipcs_sendv(crm_client_t * c, struct iovec *iov, enum crm_ipc_flags flags);
+
+/* A large message can be published once in shared memory, so that sending
+ * it to each local client only sends a reference to it
+ */
+typedef struct crm_ipc_published_s crm_ipc_published_t;
+
+crm_ipc_published_t *crm_ipcs_publish(struct iovec *iov);
+ssize_t crm_ipcs_sendv_published(crm_client_t * c, struct iovec *iov,
+                                 crm_ipc_published_t *published, enum crm_ipc_flags flags);
+void crm_ipcs_unpublish(crm_ipc_published_t *published);
 xmlNode *crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t * flags);
 
 int crm_ipcs_client_pid(qb_ipcs_connection_t * c);
@@ -119,4 +119,20 @@ do {
     }                                                                           \
 } while (0)
 
+/* Feature set from which peers can compare CIBs via Merkle-style digests */
+#  define CRM_MERKLE_DIGEST_VERSION "3.0.15"
+
+void crm_xml_merkle_digest(xmlNode *xml, gboolean do_filter, unsigned char *digest);
+char *calculate_xml_merkle_digest(xmlNode *input, gboolean do_filter);
+char *calculate_cib_peer_digest(xmlNode *input, const char *version);
+
+size_t crm_xml_unformatted_size(xmlNode *xml);
+char *crm_xml_unformatted_write(xmlNode *xml, char *buffer);
+
+char *crm_xml_binary_encode(xmlNode *xml, size_t *length);
+bool crm_xml_is_binary(const char *buffer, size_t length);
+int crm_xml_binary_decode(const char *buffer, size_t length, xmlNode **xml);
+
+void crm_xml_private_stats(unsigned long *allocs, unsigned long *slabs);
+
 #endif
@@ -241,6 +241,7 @@ extern void resource_location(resource_t * rsc, node_t * node, int score, const
                               pe_working_set_t * data_set);
 
 extern gint sort_op_by_callid(gconstpointer a, gconstpointer b);
+GListPtr pe_sort_rsc_ops(GListPtr op_list);
 extern gboolean get_target_role(resource_t * rsc, enum rsc_role_e *role);
 
 extern resource_t *find_clone_instance(resource_t * rsc, const char *sub_id,
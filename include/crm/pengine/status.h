@@ -81,6 +81,17 @@ enum pe_find {
 
 #  define pe_flag_quick_location        0x00100000ULL
 #  define pe_flag_sanitized             0x00200000ULL
+#  define pe_flag_low_memory            0x00400000ULL
+#  define pe_flag_limit_memory          0x00800000ULL
+
+/* Approximate memory (in bytes) held by a working set, by category */
+typedef struct pe_memory_usage_s {
+    size_t actions;
+    size_t nodes;
+    size_t hash_tables;
+    size_t xml;
+    size_t strings;
+} pe_memory_usage_t;
 
 typedef struct pe_working_set_s {
     xmlNode *input;
@@ -132,6 +143,10 @@ typedef struct pe_working_set_s {
     int blocked_resources;
     int disabled_resources;
 
+    pe_memory_usage_t memory;
+    size_t memory_limit;    /* from pe-memory-limit, 0 if unlimited */
+    size_t memory_estimate; /* expected peak, estimated before unpacking status */
+
 } pe_working_set_t;
 
 struct node_shared_s {
@@ -466,6 +481,9 @@ const char *rsc_printable_id(resource_t *rsc);
 gboolean cluster_status(pe_working_set_t * data_set);
 void set_working_set_defaults(pe_working_set_t * data_set);
 void cleanup_calculations(pe_working_set_t * data_set);
+void pe_calculate_memory_usage(pe_working_set_t * data_set);
+size_t pe_memory_usage_total(const pe_memory_usage_t * usage);
+size_t pe_estimate_memory_usage(pe_working_set_t * data_set);
 resource_t *pe_find_resource(GListPtr rsc_list, const char *id_rh);
 resource_t *pe_find_resource_with_flags(GListPtr rsc_list, const char *id, enum pe_find flags);
 node_t *pe_find_node(GListPtr node_list, const char *uname);
@@ -161,6 +161,20 @@ cib_client_update(cib_t * cib, const char *section, xmlNode * data, int call_opt
     return cib_internal_op(cib, CIB_OP_MODIFY, NULL, section, data, NULL, call_options, NULL);
 }
 
+static int
+cib_client_register_diff_filter(cib_t * cib, const char *filter, int enabled)
+{
+    return -EPROTONOSUPPORT;
+}
+
+static int
+cib_client_transaction(cib_t * cib, xmlNode * transaction, int call_options)
+{
+    op_common(cib);
+    return cib_internal_op(cib, CIB_OP_TRANSACTION, NULL, NULL, transaction, NULL,
+                           call_options, NULL);
+}
+
 static int
 cib_client_replace(cib_t * cib, const char *section, xmlNode * data, int call_options)
 {
@@ -402,6 +416,8 @@ cib_new_variant(void)
     new_cib->cmds->erase = cib_client_erase;
 
     new_cib->cmds->delete_absolute = cib_client_delete_absolute;
+    new_cib->cmds->transaction = cib_client_transaction;
+    new_cib->cmds->register_diff_filter = cib_client_register_diff_filter;
 
     return new_cib;
 }
@@ -473,6 +473,164 @@ cib_file_write_with_digest(xmlNode *cib_root, const char *cib_dirname,
     return exit_rc;
 }
 
+/*!
+ * \internal
+ * \brief Get the configuration version (admin_epoch, epoch) of a CIB
+ *
+ * \param[in]  cib      CIB to check
+ * \param[out] version  Where to store the version (2 elements)
+ */
+void
+cib_file_journal_version(xmlNode *cib, int *version)
+{
+    version[0] = 0;
+    version[1] = 0;
+    crm_element_value_int(cib, XML_ATTR_GENERATION_ADMIN, &(version[0]));
+    crm_element_value_int(cib, XML_ATTR_GENERATION, &(version[1]));
+}
+
+/*!
+ * \internal
+ * \brief Compare two configuration versions (admin_epoch, epoch)
+ *
+ * \return Negative, zero or positive as \p a is older, equal or newer
+ */
+int
+cib_file_journal_version_cmp(const int *a, const int *b)
+{
+    int lpc = 0;
+
+    for (lpc = 0; lpc < 2; lpc++) {
+        if (a[lpc] < b[lpc]) {
+            return -1;
+        } else if (a[lpc] > b[lpc]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * \internal
+ * \brief Parse the next record of a CIB journal
+ *
+ * \param[in]     contents  Journal contents
+ * \param[in]     max       Length of \p contents
+ * \param[in,out] offset    Start of the record, advanced past it on success
+ *
+ * \return Patchset contained in the record, or NULL if it is truncated or
+ *         does not match its checksum (e.g. after a crash mid-write)
+ */
+xmlNode *
+cib_file_journal_next(const char *contents, size_t max, size_t *offset)
+{
+    char expected[33];
+    unsigned long length = 0;
+    xmlNode *patchset = NULL;
+    const char *start = contents + *offset;
+    const char *eol = memchr(start, '\n', max - *offset);
+    size_t remaining = 0;
+
+    if (eol == NULL || sscanf(start, "%lu %32s", &length, expected) != 2) {
+        return NULL;
+    }
+
+    remaining = max - (eol + 1 - contents);
+    if (length >= remaining || eol[1 + length] != '\n') {
+        return NULL;
+    }
+
+    {
+        char *payload = strndup(eol + 1, length);
+        char *digest = crm_md5sum(payload);
+
+        if (safe_str_eq(digest, expected)) {
+            patchset = string2xml(payload);
+        }
+        free(digest);
+        free(payload);
+    }
+
+    if (patchset) {
+        *offset = (eol + 1 + length + 1) - contents;
+    }
+    return patchset;
+}
+
+/*!
+ * \internal
+ * \brief Apply journalled changes newer than a CIB read from disk
+ *
+ * Records already contained in \p root are skipped, so a journal that
+ * outlived its compaction (or a backup being used) is harmless.  Replay
+ * stops at the first record that is corrupt or does not follow on from
+ * the current version.
+ *
+ * \param[in,out] root      CIB read from disk
+ * \param[in]     contents  Journal contents
+ * \param[in]     max       Length of \p contents
+ * \param[out]    records   Number of valid records (or NULL)
+ * \param[out]    applied   Number of records applied to \p root (or NULL)
+ *
+ * \return Length of the valid part of \p contents
+ */
+size_t
+cib_file_journal_replay(xmlNode *root, const char *contents, size_t max,
+                        int *records, int *applied)
+{
+    size_t offset = 0;
+    size_t valid = 0;
+    xmlNode *patchset = NULL;
+
+    if (records) {
+        *records = 0;
+    }
+    if (applied) {
+        *applied = 0;
+    }
+
+    while ((patchset = cib_file_journal_next(contents, max, &offset)) != NULL) {
+        int rc = pcmk_ok;
+        int current[2];
+        int add[] = { 0, 0, 0 };
+        int del[] = { 0, 0, 0 };
+
+        cib_file_journal_version(root, current);
+        xml_patch_versions(patchset, add, del);
+
+        if (cib_file_journal_version_cmp(add, current) <= 0) {
+            crm_trace("Skipping journalled %d.%d (have %d.%d)",
+                      add[0], add[1], current[0], current[1]);
+
+        } else if (cib_file_journal_version_cmp(del, current) != 0) {
+            crm_warn("Journalled changes %d.%d -> %d.%d do not follow on from %d.%d",
+                     del[0], del[1], add[0], add[1], current[0], current[1]);
+            rc = -pcmk_err_diff_resync;
+
+        } else {
+            rc = xml_apply_patchset(root, patchset, FALSE);
+            if (rc == pcmk_ok) {
+                if (applied) {
+                    (*applied)++;
+                }
+            } else {
+                crm_err("Could not apply journalled changes %d.%d -> %d.%d: %s",
+                        del[0], del[1], add[0], add[1], pcmk_strerror(rc));
+            }
+        }
+
+        free_xml(patchset);
+        if (rc != pcmk_ok) {
+            break;
+        }
+        if (records) {
+            (*records)++;
+        }
+        valid = offset;
+    }
+    return valid;
+}
+
 cib_t *
 cib_file_new(const char *cib_location)
 {
@@ -547,6 +705,30 @@ load_file_cib(const char *filename)
         create_xml_node(root, XML_CIB_TAG_STATUS);
     }
 
+    /* The cib daemon only rewrites the live CIB now and then, journalling
+     * configuration changes alongside it in the meantime
+     */
+    if (cib_file_is_live(filename)) {
+        char *dir = crm_compat_realpath(filename);
+        char *journal = NULL;
+        char *contents = NULL;
+        int applied = 0;
+
+        *strrchr(dir, '/') = 0;
+        journal = crm_concat(dir, CIB_JOURNAL_FILE, '/');
+        contents = crm_read_contents(journal);
+        if (contents) {
+            cib_file_journal_replay(root, contents, strlen(contents), NULL, &applied);
+            if (applied) {
+                crm_info("Applied %d change%s journalled in %s",
+                         applied, (applied == 1)? "" : "s", journal);
+            }
+        }
+        free(contents);
+        free(journal);
+        free(dir);
+    }
+
     /* Validate XML against its specified DTD */
     ignore_dtd = crm_element_value(root, XML_ATTR_VALIDATION);
     if (validate_xml(root, NULL, TRUE) == FALSE) {
@@ -758,6 +940,7 @@ static struct cib_func_entry cib_file_ops[] = {
     {CIB_OP_DELETE,     FALSE, cib_process_delete},
     {CIB_OP_ERASE,      FALSE, cib_process_erase},
     {CIB_OP_UPGRADE,    FALSE, cib_process_upgrade},
+    {CIB_OP_TRANSACTION, FALSE, cib_process_transaction},
 };
 /* *INDENT-ON* */
 
@@ -37,6 +37,10 @@ typedef struct cib_native_opaque_s {
     void (*dnotify_fn) (gpointer user_data);
     mainloop_io_t *source;
 
+    /* Last asynchronous update not yet known to have been processed */
+    int unconfirmed_update;
+    cib_snapshot_t snapshot;
+
 } cib_native_opaque_t;
 
 int cib_native_perform_op(cib_t * cib, const char *op, const char *host, const char *section,
@@ -78,6 +82,7 @@ cib_native_new(void)
     cib->cmds->free = cib_native_free;
 
     cib->cmds->register_notification = cib_native_register_notification;
+    cib->cmds->register_diff_filter = cib_native_register_diff_filter;
     cib->cmds->set_connection_dnotify = cib_native_set_connection_dnotify;
 
     return cib;
@@ -117,6 +122,14 @@ cib_native_dispatch_internal(const char *buffer, ssize_t length, gpointer userda
     crm_log_xml_explicit(msg, "cib-reply");
 
     if (safe_str_eq(type, T_CIB)) {
+        cib_native_opaque_t *native = cib->variant_opaque;
+        int call_id = 0;
+
+        /* Requests are processed in order, so earlier updates are done too */
+        crm_element_value_int(msg, F_CIB_CALLID, &call_id);
+        if (call_id >= native->unconfirmed_update) {
+            native->unconfirmed_update = 0;
+        }
         cib_native_callback(cib, msg, 0, 0);
 
     } else if (safe_str_eq(type, T_CIB_NOTIFY)) {
@@ -316,6 +329,7 @@ cib_native_free(cib_t * cib)
         cib_native_opaque_t *native = cib->variant_opaque;
 
         free(native->token);
+        free_xml(native->snapshot.cib);
         free(cib->variant_opaque);
         free(cib->cmds);
         free(cib);
@@ -332,6 +346,58 @@ cib_native_perform_op(cib_t * cib, const char *op, const char *host, const char
                                           data, output_data, call_options, NULL);
 }
 
+/*!
+ * \internal
+ * \brief Answer a local query from the daemon's published CIB snapshot
+ *
+ * \return Result of the query, or -EAGAIN if there is no usable snapshot
+ */
+static int
+cib_native_query_snapshot(cib_t * cib, const char *section, xmlNode * data,
+                          xmlNode ** output_data, int call_options)
+{
+    int rc = pcmk_ok;
+    gboolean changed = FALSE;
+    xmlNode *request = NULL;
+    xmlNode *output = NULL;
+    xmlNode *result_cib = NULL;
+    xmlNode *snapshot = NULL;
+    cib_op_t fn = cib_process_query;
+    cib_native_opaque_t *native = cib->variant_opaque;
+
+    if (native->unconfirmed_update) {
+        /* The snapshot might not have our own changes yet */
+        return -EAGAIN;
+    }
+
+    snapshot = cib_snapshot_read(&native->snapshot);
+    if (snapshot == NULL) {
+        return -EAGAIN;
+    }
+
+    request = cib_create_op(cib->call_id, "snapshot", CIB_OP_QUERY, NULL, section, data,
+                            call_options, NULL);
+    rc = cib_perform_op(CIB_OP_QUERY, call_options, &fn, TRUE, section,
+                        request, data, FALSE, &changed, snapshot, &result_cib, NULL,
+                        &output);
+    free_xml(request);
+    if (result_cib != snapshot) {
+        free_xml(result_cib);
+    }
+
+    if (output && output->doc == snapshot->doc) {
+        /* The parsed snapshot is kept for later queries */
+        *output_data = copy_xml(output);
+
+    } else {
+        *output_data = output;
+    }
+
+    crm_trace("Answered %s query from the CIB snapshot: %s",
+              crm_str(section), pcmk_strerror(rc));
+    return rc;
+}
+
 int
 cib_native_perform_op_delegate(cib_t * cib, const char *op, const char *host, const char *section,
                                xmlNode * data, xmlNode ** output_data, int call_options,
@@ -359,6 +425,16 @@ cib_native_perform_op_delegate(cib_t * cib, const char *op, const char *host, co
         return -EINVAL;
     }
 
+    if (safe_str_eq(op, CIB_OP_QUERY) && is_set(call_options, cib_sync_call)
+        && host == NULL && user_name == NULL && output_data != NULL) {
+
+        rc = cib_native_query_snapshot(cib, section, data, output_data, call_options);
+        if (rc != -EAGAIN) {
+            return rc;
+        }
+        rc = pcmk_ok;
+    }
+
     if (call_options & cib_sync_call) {
         ipc_flags |= crm_ipc_client_response;
     }
@@ -397,6 +473,9 @@ cib_native_perform_op_delegate(cib_t * cib, const char *op, const char *host, co
     if (!(call_options & cib_sync_call)) {
         crm_trace("Async call, returning %d", cib->call_id);
         CRM_CHECK(cib->call_id != 0, return -ENOMSG);
+        if (safe_str_neq(op, CIB_OP_QUERY)) {
+            native->unconfirmed_update = cib->call_id;
+        }
         free_xml(op_reply);
         return cib->call_id;
     }
@@ -404,6 +483,8 @@ cib_native_perform_op_delegate(cib_t * cib, const char *op, const char *host, co
     rc = pcmk_ok;
     crm_element_value_int(op_reply, F_CIB_CALLID, &reply_id);
     if (reply_id == cib->call_id) {
+        /* Anything we sent before this has been processed by now */
+        native->unconfirmed_update = 0;
         xmlNode *tmp = get_message_xml(op_reply, F_CIB_CALLDATA);
 
         crm_trace("Synchronous reply %d received", reply_id);
@@ -489,25 +570,51 @@ cib_native_set_connection_dnotify(cib_t * cib, void (*dnotify) (gpointer user_da
     return pcmk_ok;
 }
 
-int
-cib_native_register_notification(cib_t * cib, const char *callback, int enabled)
+static int
+cib_native_send_notify(cib_t * cib, const char *callback, const char *filter, int enabled)
 {
     int rc = pcmk_ok;
+    xmlNode *reply = NULL;
     xmlNode *notify_msg = create_xml_node(NULL, "cib-callback");
     cib_native_opaque_t *native = cib->variant_opaque;
 
     if (cib->state != cib_disconnected) {
         crm_xml_add(notify_msg, F_CIB_OPERATION, T_CIB_NOTIFY);
         crm_xml_add(notify_msg, F_CIB_NOTIFY_TYPE, callback);
+        crm_xml_add(notify_msg, F_CIB_NOTIFY_FILTER, filter);
         crm_xml_add_int(notify_msg, F_CIB_NOTIFY_ACTIVATE, enabled);
         rc = crm_ipc_send(native->ipc, notify_msg, crm_ipc_client_response,
-                          1000 * cib->call_timeout, NULL);
+                          1000 * cib->call_timeout, filter? &reply : NULL);
         if (rc <= 0) {
             crm_trace("Notification not registered: %d", rc);
             rc = -ECOMM;
+
+        } else if (reply && crm_element_value(reply, F_CIB_RC)) {
+            /* Only failures carry a result */
+            crm_element_value_int(reply, F_CIB_RC, &rc);
         }
     }
 
+    free_xml(reply);
     free_xml(notify_msg);
     return rc;
 }
+
+int
+cib_native_register_notification(cib_t * cib, const char *callback, int enabled)
+{
+    return cib_native_send_notify(cib, callback, NULL, enabled);
+}
+
+int
+cib_native_register_diff_filter(cib_t * cib, const char *filter, int enabled)
+{
+    char *path = cib_diff_filter_path(filter);
+
+    if (path == NULL) {
+        crm_err("Invalid diff filter: %s", crm_str(filter));
+        return -EINVAL;
+    }
+    free(path);
+    return cib_native_send_notify(cib, T_CIB_DIFF_NOTIFY, filter, enabled);
+}
@@ -586,6 +586,78 @@ cib_process_create(const char *op, int options, const char *section, xmlNode * r
     return result;
 }
 
+/*!
+ * \internal
+ * \brief Apply each command of a transaction to the same scratch CIB
+ *
+ * Since this is a single operation as far as cib_perform_op() is concerned,
+ * the commands are applied atomically and result in one diff (and so one
+ * broadcast, disk write and notification) between them.
+ *
+ * \param[in] input  Transaction, as built by cib_transaction_add()
+ *
+ * \return pcmk_ok if every command succeeded, otherwise the result of the
+ *         first one that failed (whose answer, if any, is passed back)
+ */
+int
+cib_process_transaction(const char *op, int options, const char *section, xmlNode * req,
+                        xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
+                        xmlNode ** answer)
+{
+    int rc = pcmk_ok;
+    xmlNode *command = NULL;
+
+    crm_trace("Processing \"%s\" event", op);
+
+    if (input == NULL) {
+        crm_err("Cannot perform transaction with no commands");
+        return -EINVAL;
+    }
+
+    for (command = __xml_first_child(input); command != NULL && rc == pcmk_ok;
+         command = __xml_next(command)) {
+
+        int call_options = cib_none;
+        cib_op_t fn = NULL;
+        xmlNode *output = NULL;
+        const char *cmd_op = crm_element_value(command, F_CIB_OPERATION);
+        const char *cmd_section = crm_element_value(command, F_CIB_SECTION);
+
+        if (command->type != XML_ELEMENT_NODE) {
+            continue;
+
+        } else if (safe_str_eq(cmd_op, CIB_OP_CREATE)) {
+            fn = cib_process_create;
+
+        } else if (safe_str_eq(cmd_op, CIB_OP_MODIFY)) {
+            fn = cib_process_modify;
+
+        } else if (safe_str_eq(cmd_op, CIB_OP_DELETE)) {
+            fn = cib_process_delete;
+
+        } else {
+            crm_err("Operation %s is not supported in transactions", crm_str(cmd_op));
+            rc = -EOPNOTSUPP;
+            break;
+        }
+
+        crm_element_value_int(command, F_CIB_CALLOPTS, &call_options);
+        rc = fn(cmd_op, call_options, cmd_section, req, __xml_first_child_element(command),
+                existing_cib, result_cib, &output);
+
+        if (rc == pcmk_ok) {
+            free_xml(output);
+
+        } else {
+            crm_info("Transaction %s of %s failed: %s",
+                     cmd_op, crm_str(cmd_section), pcmk_strerror(rc));
+            *answer = output;
+        }
+    }
+
+    return rc;
+}
+
 int
 cib_process_diff(const char *op, int options, const char *section, xmlNode * req, xmlNode * input,
                  xmlNode * existing_cib, xmlNode ** result_cib, xmlNode ** answer)
@@ -22,6 +22,12 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 
 #include <glib.h>
@@ -226,6 +232,65 @@ get_object_parent(const char *object_type)
     return NULL;
 }
 
+static gboolean
+diff_filter_name_char(char c)
+{
+    return isalnum((unsigned char) c) || (c == '_') || (c == '-') || (c == '.') || (c == ':');
+}
+
+/*!
+ * \internal
+ * \brief Convert a diff notification filter to the patchset path it selects
+ *
+ * Filters are matched as path prefixes rather than evaluated as XPath, so
+ * only a CIB section name, or an absolute path made of element names each
+ * optionally followed by the exact [@id='...'] predicate that patchsets
+ * use, is accepted. Anything else ("//", "*", "..", other predicates) would
+ * silently never match.
+ *
+ * \param[in] filter  CIB section name or patchset path
+ *
+ * \return Newly allocated patchset path, or NULL if \p filter is invalid
+ */
+char *
+cib_diff_filter_path(const char *filter)
+{
+    const char *p = filter;
+
+    if (filter == NULL) {
+        return NULL;
+
+    } else if (filter[0] != '/') {
+        const char *xpath = get_object_path(filter);
+
+        /* Patchset paths use a single leading slash */
+        return xpath? strdup(xpath + 1) : NULL;
+    }
+
+    while (*p == '/') {
+        p++;
+
+        /* Element names can't start with a digit, '-' or '.' */
+        if (!isalpha((unsigned char) *p) && (*p != '_')) {
+            return NULL;
+        }
+        while (diff_filter_name_char(*p)) {
+            p++;
+        }
+
+        if (strncmp(p, "[@id='", 6) == 0) {
+            const char *value = p + 6;
+
+            p = strchr(value, '\'');
+            if (p == NULL || p == value || p[1] != ']') {
+                return NULL;
+            }
+            p += 2;
+        }
+    }
+    return (*p == 0)? strdup(filter) : NULL;
+}
+
 xmlNode *
 get_object_root(const char *object_type, xmlNode * the_root)
 {
@@ -287,6 +352,125 @@ cib_acl_enabled(xmlNode *xml, const char *user)
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a request can only affect the status section
+ *
+ * \param[in] section       Section name or (with cib_xpath) XPath of the request
+ * \param[in] call_options  Call options of the request
+ *
+ * \return TRUE if the request is confined to the status section, else FALSE
+ */
+gboolean
+cib_op_targets_status(const char *section, int call_options)
+{
+    static const char *status_prefixes[] = {
+        "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS "/",
+        "//" XML_CIB_TAG_STATUS "/",
+        "//" XML_CIB_TAG_STATE,
+    };
+    int lpc = 0;
+
+    if (safe_str_eq(section, XML_CIB_TAG_STATUS)) {
+        return TRUE;
+
+    } else if (section == NULL || is_not_set(call_options, cib_xpath)) {
+        return FALSE;
+    }
+
+    /* Unions and reverse axes could reach outside the status section */
+    if (strchr(section, '|') || strstr(section, "..") || strstr(section, "::")) {
+        return FALSE;
+    }
+
+    for (lpc = 0; lpc < DIMOF(status_prefixes); lpc++) {
+        if (crm_starts_with(section, status_prefixes[lpc])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+patchset_path_in_status(const char *path)
+{
+    static const char *status_path = "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS;
+    size_t len = strlen(status_path);
+
+    return path && (strncmp(path, status_path, len) == 0)
+           && ((path[len] == '\0') || (path[len] == '/') || (path[len] == '['));
+}
+
+/*!
+ * \internal
+ * \brief Check whether a v2 patchset changes anything the schema cares about
+ *
+ * The schema places no restrictions on the status section, so there is no
+ * point validating a CIB whose only changes are within it (plus num_updates
+ * and the bookkeeping attributes that every change touches).  A change to
+ * the epoch is a configuration change, whoever made it.
+ *
+ * \param[in] patchset  Patchset to check
+ *
+ * \return TRUE if \p patchset only changes status or version counters
+ */
+static gboolean
+patchset_only_status(xmlNode *patchset)
+{
+    int format = 1;
+    xmlNode *change = NULL;
+
+    if (patchset == NULL) {
+        return FALSE;
+    }
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        return FALSE;
+    }
+
+    for (change = __xml_first_child(patchset); change != NULL;
+         change = __xml_next_element(change)) {
+        const char *op = crm_element_value(change, XML_DIFF_OP);
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+        if (safe_str_neq((const char *) change->name, XML_DIFF_CHANGE)
+            || patchset_path_in_status(path)) {
+            continue;
+
+        } else if (safe_str_eq(path, "/" XML_TAG_CIB) && safe_str_eq(op, "create")) {
+            /* Only acceptable if it is the status section being created */
+            xmlNode *created = __xml_first_child(change);
+
+            if (created == NULL
+                || safe_str_neq((const char *) created->name, XML_CIB_TAG_STATUS)) {
+                return FALSE;
+            }
+
+        } else if (safe_str_eq(path, "/" XML_TAG_CIB) && safe_str_eq(op, "modify")) {
+            xmlNode *attr = NULL;
+            xmlNode *list = first_named_child(change, XML_DIFF_LIST);
+
+            for (attr = __xml_first_child(list); attr != NULL;
+                 attr = __xml_next_element(attr)) {
+                const char *name = crm_element_value(attr, XML_NVPAIR_ATTR_NAME);
+
+                if (safe_str_neq(name, XML_ATTR_NUMUPDATES)
+                    && safe_str_neq(name, XML_CIB_ATTR_WRITTEN)
+                    && safe_str_neq(name, XML_ATTR_UPDATE_ORIG)
+                    && safe_str_neq(name, XML_ATTR_UPDATE_CLIENT)
+                    && safe_str_neq(name, XML_ATTR_UPDATE_USER)) {
+                    return FALSE;
+                }
+            }
+
+        } else {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 int
 cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_query,
                const char *section, xmlNode * req, xmlNode * input,
@@ -499,12 +683,33 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         free_xml(c);
     }
 
-    if (safe_str_eq(section, XML_CIB_TAG_STATUS)) {
+    if (is_set(call_options, cib_zero_copy)) {
+        /* Status changes made in place cannot be rolled back, and the schema
+         * doesn't restrict the status section anyway
+         */
+        check_dtd = FALSE;
+
+    } else if (cib_op_targets_status(section, call_options)) {
         /* Throttle the amount of costly validation we perform due to status updates
          * a) we don't really care whats in the status section
          * b) we don't validate any of its contents at the moment anyway
          */
         check_dtd = FALSE;
+
+    } else if (patchset_only_status(local_diff)) {
+        /* A request that could have changed the configuration turned out
+         * not to, so validation can mostly be skipped.  Still validate the
+         * whole CIB every few minutes, in case something we didn't expect
+         * slipped through (these requests were always validated before).
+         */
+        static time_t next_full_validation = 0;
+        time_t tm_now = time(NULL);
+
+        if (next_full_validation > tm_now) {
+            check_dtd = FALSE;
+        } else {
+            next_full_validation = tm_now + 300;
+        }
     }
 
     /* === scratch must not be modified after this point ===
@@ -563,7 +768,9 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
 
     *result_cib = scratch;
 #if ENABLE_ACL
-    if(rc != pcmk_ok && cib_acl_enabled(current_cib, user)) {
+    /* With zero-copy, scratch is the live CIB and must not be freed */
+    if(rc != pcmk_ok && is_not_set(call_options, cib_zero_copy)
+       && cib_acl_enabled(current_cib, user)) {
         if(xml_acl_filtered_copy(user, current_cib, scratch, result_cib)) {
             if (*result_cib == NULL) {
                 crm_debug("Pre-filtered the entire cib result");
@@ -619,6 +826,40 @@ cib_create_op(int call_id, const char *token, const char *op, const char *host,
     return op_msg;
 }
 
+/*!
+ * \brief Add a command to a CIB transaction
+ *
+ * \param[in,out] transaction   Transaction to add to, or NULL to start one
+ * \param[in]     op            CIB_OP_CREATE, CIB_OP_MODIFY or CIB_OP_DELETE
+ * \param[in]     section       Section (or XPath with cib_xpath) to act on
+ * \param[in]     data          XML to create, modify or delete (copied)
+ * \param[in]     call_options  Per-command options, e.g. cib_xpath
+ *
+ * \return The transaction, to be sent with cib->cmds->transaction() and
+ *         freed by the caller
+ * \note Servers that predate transactions reject them with -EINVAL,
+ *       in which case the commands need to be sent individually.
+ */
+xmlNode *
+cib_transaction_add(xmlNode * transaction, const char *op, const char *section,
+                    xmlNode * data, int call_options)
+{
+    xmlNode *command = NULL;
+
+    if (transaction == NULL) {
+        transaction = create_xml_node(NULL, CIB_OP_TRANSACTION);
+    }
+
+    command = create_xml_node(transaction, "cib_command");
+    crm_xml_add(command, F_CIB_OPERATION, op);
+    crm_xml_add(command, F_CIB_SECTION, section);
+    crm_xml_add_int(command, F_CIB_CALLOPTS, call_options);
+    if (data != NULL) {
+        add_node_copy(command, data);
+    }
+    return transaction;
+}
+
 void
 cib_native_callback(cib_t * cib, xmlNode * msg, int call_id, int rc)
 {
@@ -849,3 +1090,81 @@ cib_internal_op(cib_t * cib, const char *op, const char *host,
 
     return delegate(cib, op, host, section, data, output_data, call_options, user_name);
 }
+
+/*!
+ * \internal
+ * \brief Get the current CIB from the snapshot published by the local daemon
+ *
+ * \param[in,out] cache  Parsed copy of the last snapshot used, which is reused
+ *                       if still current and replaced otherwise
+ *
+ * \return Current CIB (owned by \p cache), or NULL if no current snapshot is
+ *         available
+ * \note Only the daemon user and root can read the snapshot, so ACLs don't
+ *       apply to anyone who can use it.
+ */
+xmlNode *
+cib_snapshot_read(cib_snapshot_t *cache)
+{
+    int fd = -1;
+    struct stat sb;
+    char *map = NULL;
+    xmlNode *current = NULL;
+    cib_snapshot_header_t *header = NULL;
+
+    fd = open(CIB_SNAPSHOT_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        goto done;
+    }
+
+    if (fstat(fd, &sb) < 0 || sb.st_size <= (off_t) sizeof(cib_snapshot_header_t)) {
+        close(fd);
+        goto done;
+    }
+
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        crm_perror(LOG_DEBUG, "Could not map %s", CIB_SNAPSHOT_FILE);
+        goto done;
+    }
+
+    header = (cib_snapshot_header_t *) map;
+    if (header->magic != CIB_SNAPSHOT_MAGIC || header->format != CIB_SNAPSHOT_FORMAT
+        || header->length + sizeof(cib_snapshot_header_t) > (size_t) sb.st_size
+        || map[sizeof(cib_snapshot_header_t) + header->length - 1] != 0) {
+        crm_debug("Ignoring invalid CIB snapshot in %s", CIB_SNAPSHOT_FILE);
+
+    } else if (header->stale) {
+        crm_trace("CIB snapshot %llu is stale", (unsigned long long) header->epoch);
+
+    } else if (kill(header->pid, 0) < 0 && errno != EPERM) {
+        /* A daemon that died without cleaning up can't mark it stale either */
+        crm_debug("Ignoring CIB snapshot from defunct process %u",
+                  (unsigned int) header->pid);
+
+    } else if (cache->cib && cache->pid == header->pid && cache->epoch == header->epoch) {
+        current = cache->cib;
+
+    } else {
+        free_xml(cache->cib);
+        cache->cib = string2xml(map + sizeof(cib_snapshot_header_t));
+        cache->epoch = header->epoch;
+        cache->pid = header->pid;
+        current = cache->cib;
+        crm_trace("Parsed CIB snapshot %llu", (unsigned long long) header->epoch);
+    }
+
+    /* The text can't change under us, but the CIB may have moved on */
+    if (current && header->stale) {
+        current = NULL;
+    }
+    munmap(map, sb.st_size);
+
+  done:
+    if (current == NULL) {
+        free_xml(cache->cib);
+        cache->cib = NULL;
+    }
+    return current;
+}
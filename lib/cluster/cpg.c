@@ -288,25 +288,27 @@ pcmk_message_common_cs(cpg_handle_t handle, uint32_t nodeid, uint32_t pid, void
     }
 
     if (msg->is_compressed && msg->size > 0) {
-        int rc = BZ_OK;
+        int rc = pcmk_ok;
         char *uncompressed = NULL;
         unsigned int new_size = msg->size + 1;
 
+        /* Older peers set is_compressed to TRUE, which means bzip2 */
+        enum crm_compression codec = (enum crm_compression) msg->is_compressed;
+
         if (check_message_sanity(msg, NULL) == FALSE) {
             goto badmsg;
         }
 
-        crm_trace("Decompressing message data");
+        crm_trace("Decompressing %s message data", crm_compression_text(codec));
         uncompressed = calloc(1, new_size);
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed, &new_size, msg->data, msg->compressed_size, 1, 0);
+        rc = crm_decompress_string(codec, msg->data, msg->compressed_size,
+                                   uncompressed, &new_size);
 
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %d", rc);
+        if (rc != pcmk_ok) {
             free(uncompressed);
             goto badmsg;
         }
 
-        CRM_ASSERT(rc == BZ_OK);
         CRM_ASSERT(new_size == msg->size);
 
         data = uncompressed;
@@ -517,6 +519,37 @@ send_cluster_message_cs(xmlNode * msg, gboolean local, crm_node_t * node, enum c
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Choose how to compress large CPG messages
+ *
+ * Peers' capabilities are not known here, so lz4 is used only when the
+ * administrator has asked for it (all nodes must be able to decompress it).
+ *
+ * \return Compression to use for outgoing messages
+ */
+static enum crm_compression
+cluster_compression(void)
+{
+    static enum crm_compression codec = crm_compression_none;
+
+    if (codec == crm_compression_none) {
+        const char *value = daemon_option("cluster_compression");
+
+        codec = crm_compression_bz2;
+        if (safe_str_eq(value, crm_compression_text(crm_compression_lz4))) {
+            if (crm_compression_supported(crm_compression_lz4)) {
+                codec = crm_compression_lz4;
+            } else {
+                crm_warn("Using bzip2 for cluster messages: lz4 support was not built");
+            }
+        } else if (value && safe_str_neq(value, crm_compression_text(crm_compression_bz2))) {
+            crm_warn("Using bzip2 for cluster messages: unknown compression '%s'", value);
+        }
+    }
+    return codec;
+}
+
 gboolean
 send_cluster_text(int class, const char *data,
               gboolean local, crm_node_t * node, enum crm_ais_msg_types dest)
@@ -602,14 +635,15 @@ send_cluster_text(int class, const char *data,
         char *compressed = NULL;
         unsigned int new_size = 0;
         char *uncompressed = strdup(data);
+        enum crm_compression codec = cluster_compression();
 
-        if (crm_compress_string(uncompressed, msg->size, 0, &compressed, &new_size)) {
+        if (crm_compress_string_as(codec, uncompressed, msg->size, 0, &compressed, &new_size)) {
 
             msg->header.size = sizeof(AIS_Message) + new_size;
             msg = realloc_safe(msg, msg->header.size);
             memcpy(msg->data, compressed, new_size);
 
-            msg->is_compressed = TRUE;
+            msg->is_compressed = codec;
             msg->compressed_size = new_size;
 
         } else {
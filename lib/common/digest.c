@@ -26,6 +26,8 @@
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
+#include <crm/common/xml_internal.h>
+#include <md5.h>
 
 #define BEST_EFFORT_STATUS 0
 
@@ -209,6 +211,59 @@ calculate_xml_versioned_digest(xmlNode * input, gboolean sort, gboolean do_filte
     return calculate_xml_digest_v2(input, do_filter);
 }
 
+/*!
+ * \internal
+ * \brief Calculate and return Merkle-style digest of XML tree
+ *
+ * Unlike v2 digests, this only needs to revisit elements that changed since
+ * the last calculation (and their ancestors).  The result is not comparable
+ * with any other digest format, so peers must agree on using it
+ * (see CRM_MERKLE_DIGEST_VERSION).
+ *
+ * \param[in] input Root of XML to digest
+ * \param[in] do_filter Whether to filter certain XML attributes of the root
+ *
+ * \return Newly allocated string containing digest
+ */
+char *
+calculate_xml_merkle_digest(xmlNode *input, gboolean do_filter)
+{
+    int lpc = 0;
+    char *digest = NULL;
+    unsigned char raw_digest[MD5_DIGEST_SIZE];
+
+    CRM_CHECK(input != NULL, return NULL);
+
+    crm_xml_merkle_digest(input, do_filter, raw_digest);
+
+    digest = malloc(2 * MD5_DIGEST_SIZE + 1);
+    CRM_ASSERT(digest != NULL);
+    for (lpc = 0; lpc < MD5_DIGEST_SIZE; lpc++) {
+        sprintf(digest + (2 * lpc), "%02x", raw_digest[lpc]);
+    }
+    digest[(2 * MD5_DIGEST_SIZE)] = 0;
+    crm_trace("Merkle digest %s", digest);
+    return digest;
+}
+
+/*!
+ * \internal
+ * \brief Calculate the digest of a CIB for comparison with a peer's
+ *
+ * \param[in] input Root of CIB to digest
+ * \param[in] version Feature set both sides are known to support
+ *
+ * \return Newly allocated string containing digest
+ */
+char *
+calculate_cib_peer_digest(xmlNode *input, const char *version)
+{
+    if (version && compare_version(version, CRM_MERKLE_DIGEST_VERSION) >= 0) {
+        return calculate_xml_merkle_digest(input, TRUE);
+    }
+    return calculate_xml_versioned_digest(input, FALSE, TRUE, version);
+}
+
 /*!
  * \internal
  * \brief Return whether calculated digest of XML tree matches expected digest
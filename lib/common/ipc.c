@@ -23,23 +23,27 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <grp.h>
 
 #include <errno.h>
 #include <fcntl.h>
-#include <bzlib.h>
 
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/common/ipc.h>
 #include <crm/common/ipcs.h>
+#include <crm/common/xml_internal.h>
 
 #define PCMK_IPC_VERSION 1
 
 /* Evict clients whose event queue grows this large (by default) */
 #define PCMK_IPC_DEFAULT_QUEUE_MAX 500
 
+/* How soon to retry responses that did not fit in a client's buffer (ms) */
+#define CRM_IPC_REPLY_RETRY_MS 50
+
 struct crm_ipc_response_header {
     struct qb_ipc_response_header qb;
     uint32_t size_uncompressed;
@@ -48,9 +52,57 @@ struct crm_ipc_response_header {
     uint8_t  version; /* Protect against version changes for anyone that might bother to statically link us */
 };
 
+/* Flags describing how a particular payload was encoded. These are set while
+ * preparing and splitting messages, never copied from a caller's flags (the
+ * IPC proxy passes on the flags of the requests it relays).
+ */
+#define CRM_IPC_ENCODING_FLAGS (crm_ipc_compressed | crm_ipc_binary | crm_ipc_lz4 \
+                                | crm_ipc_multipart | crm_ipc_multipart_end | crm_ipc_bulk)
+
+/* Large messages for local clients can be published once in a shared memory
+ * area (see crm_ipcs_publish()), and each client sent a reference to them.
+ * The area is used as a ring of slots, each holding a complete message
+ * (header and payload) along with a mask of consumers yet to read it.
+ * Clients map the area read-only, and send the reference back once they
+ * have copied the message out, for the server to clear their bit.
+ */
+#define CRM_IPC_BULK_MAGIC      0x42554c4b      /* "BULK" */
+#define CRM_IPC_BULK_MIN        (32 * 1024)     /* Smaller payloads are sent as usual */
+#define CRM_IPC_BULK_PUBLISHER  63              /* Mask bit held while publishing */
+
+struct crm_ipc_bulk_slot {
+    uint32_t magic;
+    uint32_t generation;    /* Tells successive uses of the same space apart */
+    uint32_t length;        /* Size of the message following the slot header */
+    uint32_t padding;
+    uint64_t pending;       /* Consumers (by bit) that have yet to read it */
+};
+
+/* Payload of a crm_ipc_bulk message (in either direction) */
+struct crm_ipc_bulk_ref {
+    char area[64];          /* Name of the shared memory object */
+    uint32_t offset;        /* Where the slot is within it */
+    uint32_t generation;
+    uint32_t length;
+    uint32_t consumer;      /* Bit in the slot's mask for the recipient */
+};
+
+/* An event held back for a lagging client: either XML that later events
+ * of the same kind are merged into, or an already prepared message
+ */
+struct crm_ipcs_held_s {
+    xmlNode *xml;
+    crm_ipcs_merge_fn merge;
+    struct iovec *iov;
+};
+
 static int hdr_offset = 0;
 static unsigned int ipc_buffer_max = 0;
 static unsigned int pick_ipc_buffer(unsigned int max);
+static void crm_ipcs_bulk_forget(crm_client_t * c);
+static void crm_ipcs_bulk_ack(crm_client_t * c, const char *data);
+static void crm_ipcs_held_free(gpointer data);
+static int internal_ipc_send_request(crm_ipc_t * client, const void *iov, int ms_timeout);
 
 static inline void
 crm_ipc_init(void)
@@ -386,6 +438,15 @@ crm_client_destroy(crm_client_t * c)
         g_source_remove(c->event_timer);
     }
 
+    if (c->events_merged) {
+        crm_info("Client %s had up to %u queued events, %u notifications were merged",
+                 crm_client_name(c), c->queue_peak, c->events_merged);
+    }
+    g_list_free_full(c->held_events, crm_ipcs_held_free);
+
+    /* Any references still queued for the client will never be read */
+    crm_ipcs_bulk_forget(c);
+
     crm_debug("Destroying %d events", g_list_length(c->event_queue));
     while (c->event_queue) {
         struct iovec *event = c->event_queue->data;
@@ -396,6 +457,18 @@ crm_client_destroy(crm_client_t * c)
         free(event);
     }
 
+    if (c->reply_queue) {
+        crm_debug("Destroying %d unsent responses", g_list_length(c->reply_queue));
+    }
+    while (c->reply_queue) {
+        struct iovec *reply = c->reply_queue->data;
+
+        c->reply_queue = g_list_remove(c->reply_queue, reply);
+        free(reply[0].iov_base);
+        free(reply[1].iov_base);
+        free(reply);
+    }
+
     free(c->id);
     free(c->name);
     free(c->user);
@@ -431,6 +504,89 @@ crm_set_client_queue_max(crm_client_t *client, const char *qmax)
     return FALSE;
 }
 
+ssize_t crm_ipcs_flush_events(crm_client_t * c);
+
+static inline unsigned int
+crm_ipcs_queue_limit(crm_client_t *c)
+{
+    return QB_MAX(c->queue_max, PCMK_IPC_DEFAULT_QUEUE_MAX);
+}
+
+/*!
+ * \brief Check whether a client is falling behind on its events
+ *
+ * \param[in] c  Client to check
+ *
+ * \return TRUE if the client's event queue is at least half way to the
+ *         eviction threshold, or events are already being held for it
+ */
+bool
+crm_ipcs_client_lagging(crm_client_t *c)
+{
+    return (c->held_events != NULL)
+           || (g_list_length(c->event_queue) >= crm_ipcs_queue_limit(c) / 2);
+}
+
+static void
+crm_ipcs_held_free(gpointer data)
+{
+    struct crm_ipcs_held_s *held = data;
+
+    free_xml(held->xml);
+    if (held->iov) {
+        free(held->iov[0].iov_base);
+        free(held->iov[1].iov_base);
+        free(held->iov);
+    }
+    free(held);
+}
+
+/*!
+ * \brief Hold back an event for a lagging client, merged with any others
+ *
+ * The merged event is sent once the client's queue has drained, so a slow
+ * client gets one summary rather than falling further behind and being
+ * evicted. Any other events for the client are held behind it until then,
+ * so nothing overtakes it.
+ *
+ * \param[in,out] c      Client to hold the event for
+ * \param[in]     event  Event to hold (a copy is made if needed)
+ * \param[in]     merge  Function to combine \p event with any held event
+ */
+void
+crm_ipcs_hold_event(crm_client_t *c, xmlNode *event, crm_ipcs_merge_fn merge)
+{
+    struct crm_ipcs_held_s *last = NULL;
+
+    if (c->held_events == NULL) {
+        crm_notice("Client %s is falling behind (%u events queued), merging its "
+                   "notifications until it catches up",
+                   crm_client_name(c), g_list_length(c->event_queue));
+    } else {
+        last = g_list_last(c->held_events)->data;
+    }
+
+    if (last && last->xml && last->merge == merge) {
+        xmlNode *merged = merge(last->xml, event);
+
+        free_xml(last->xml);
+        last->xml = merged;
+        c->events_merged++;
+
+    } else {
+        /* Nothing held yet, or something unmergeable was held since */
+        last = calloc(1, sizeof(struct crm_ipcs_held_s));
+        CRM_ASSERT(last != NULL);
+        last->xml = merge(NULL, event);
+        last->merge = merge;
+        c->held_events = g_list_append(c->held_events, last);
+    }
+    c->events_held++;
+
+    /* Sends the held event straight away if the queue has already drained */
+    crm_ipcs_flush_events(c);
+}
+
 int
 crm_ipcs_client_pid(qb_ipcs_connection_t * c)
 {
@@ -441,6 +597,44 @@ crm_ipcs_client_pid(qb_ipcs_connection_t * c)
     return stats.client_pid;
 }
 
+/*!
+ * \internal
+ * \brief Get the codec a message's payload was compressed with
+ *
+ * \param[in] header  Header of a compressed message
+ *
+ * \return Compression used for the payload
+ */
+static enum crm_compression
+crm_ipc_codec(struct crm_ipc_response_header *header)
+{
+    return is_set(header->flags, crm_ipc_lz4)? crm_compression_lz4 : crm_compression_bz2;
+}
+
+/*!
+ * \internal
+ * \brief Convert a received IPC payload to XML, whichever encoding it uses
+ */
+static xmlNode *
+crm_ipc_payload_xml(struct crm_ipc_response_header *header, const char *payload)
+{
+    if (is_set(header->flags, crm_ipc_binary)) {
+        xmlNode *xml = NULL;
+        int rc = crm_xml_binary_decode(payload, header->size_uncompressed, &xml);
+
+        crm_trace("Received %u byte binary message", header->size_uncompressed);
+        if (rc != pcmk_ok) {
+            crm_warn("Discarding invalid binary message: %s " CRM_XS " rc=%d",
+                     pcmk_strerror(rc), rc);
+        }
+        return xml;
+    }
+
+    CRM_ASSERT(payload[header->size_uncompressed - 1] == 0);
+    crm_trace("Received %.200s", payload);
+    return string2xml(payload);
+}
+
 xmlNode *
 crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t * flags)
 {
@@ -456,6 +650,19 @@ crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t
         *flags = header->flags;
     }
 
+    if (is_set(header->flags, crm_ipc_binary_ok)) {
+        c->flags |= crm_client_flag_ipc_binary;
+    }
+    if (is_set(header->flags, crm_ipc_lz4_ok)) {
+        c->flags |= crm_client_flag_ipc_lz4;
+    }
+    if (is_set(header->flags, crm_ipc_multipart_ok)) {
+        c->flags |= crm_client_flag_ipc_multipart;
+    }
+    if (is_set(header->flags, crm_ipc_bulk_ok)) {
+        c->flags |= crm_client_flag_ipc_bulk;
+    }
+
     if (is_set(header->flags, crm_ipc_proxied)) {
         /* mark this client as being the endpoint of a proxy connection.
          * Proxy connections responses are sent on the event channel to avoid
@@ -469,6 +676,26 @@ crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t
         return NULL;
     }
 
+    if (is_set(header->flags, crm_ipc_bulk)) {
+        /* Not a request, just a client done with a published message */
+        if ((header->size_uncompressed == sizeof(struct crm_ipc_bulk_ref))
+            && (size >= sizeof(struct crm_ipc_response_header) + sizeof(struct crm_ipc_bulk_ref))) {
+            crm_ipcs_bulk_ack(c, text);
+        } else {
+            crm_err("Filtering malformed bulk area acknowledgement from %s",
+                    crm_client_name(c));
+        }
+        return NULL;
+    }
+
+    if (header->size_compressed == 0
+        && size < sizeof(struct crm_ipc_response_header) + header->size_uncompressed) {
+        crm_err("Filtering truncated IPC message (%u of %u bytes)",
+                (unsigned int) (size - sizeof(struct crm_ipc_response_header)),
+                header->size_uncompressed);
+        return NULL;
+    }
+
     if (header->size_compressed) {
         int rc = 0;
         unsigned int size_u = 1 + header->size_uncompressed;
@@ -477,27 +704,22 @@ crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t
         crm_trace("Decompressing message data %u bytes into %u bytes",
                   header->size_compressed, size_u);
 
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed, &size_u, text, header->size_compressed, 1, 0);
+        rc = crm_decompress_string(crm_ipc_codec(header), text,
+                                   header->size_compressed, uncompressed, &size_u);
         text = uncompressed;
 
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %s (%d)", bz2_strerror(rc), rc);
+        if (rc != pcmk_ok) {
             free(uncompressed);
             return NULL;
         }
     }
 
-    CRM_ASSERT(text[header->size_uncompressed - 1] == 0);
-
-    crm_trace("Received %.200s", text);
-    xml = string2xml(text);
+    xml = crm_ipc_payload_xml(header, text);
 
     free(uncompressed);
     return xml;
 }
 
-ssize_t crm_ipcs_flush_events(crm_client_t * c);
-
 static gboolean
 crm_ipcs_flush_events_cb(gpointer data)
 {
@@ -521,6 +743,11 @@ delay_next_flush(crm_client_t *c, unsigned int queue_len)
     /* Delay a maximum of 5 seconds */
     guint delay = (queue_len < 40)? (1000 + 100 * queue_len) : 5000;
 
+    if (c->reply_queue) {
+        /* The client is waiting for these, so retry sooner */
+        delay = CRM_IPC_REPLY_RETRY_MS;
+    }
+
     c->event_timer = g_timeout_add(delay, crm_ipcs_flush_events_cb, c);
 }
 
@@ -533,6 +760,33 @@ crm_ipcs_flush_events(crm_client_t * c)
 
     if (c == NULL) {
         return pcmk_ok;
+    }
+
+    /* Responses that didn't fit earlier go first, in order */
+    while (c->reply_queue) {
+        struct iovec *reply = c->reply_queue->data;
+        struct crm_ipc_response_header *header = reply[0].iov_base;
+
+        rc = qb_ipcs_response_sendv(c->ipcs, reply, 2);
+        if (rc < 0) {
+            break;
+        }
+        crm_trace("Queued response %d to %p[%d] (%lld bytes) sent",
+                  header->qb.id, c->ipcs, c->pid, (long long) rc);
+
+        c->reply_queue = g_list_remove(c->reply_queue, reply);
+        free(reply[0].iov_base);
+        free(reply[1].iov_base);
+        free(reply);
+    }
+    rc = 0;
+
+    if (c->event_timer && c->reply_queue) {
+        /* Don't leave waiting responses behind a long event backoff; the
+         * timer is rescheduled below with the shorter response delay
+         */
+        g_source_remove(c->event_timer);
+        c->event_timer = 0;
 
     } else if (c->event_timer) {
         /* There is already a timer, wait until it goes off */
@@ -541,6 +795,8 @@ crm_ipcs_flush_events(crm_client_t * c)
     }
 
     queue_len = g_list_length(c->event_queue);
+    c->queue_peak = QB_MAX(c->queue_peak, queue_len);
+
     while (c->event_queue && sent < 100) {
         struct crm_ipc_response_header *header = NULL;
         struct iovec *event = c->event_queue->data;
@@ -574,6 +830,44 @@ crm_ipcs_flush_events(crm_client_t * c)
                   pcmk_strerror(rc < 0 ? rc : 0), (long long) rc);
     }
 
+    if (c->held_events && queue_len <= crm_ipcs_queue_limit(c) / 4) {
+        GList *iter = NULL;
+        GList *held = c->held_events;
+
+        /* Caught up enough to take the held events. Queue them in their
+         * original order, then flush the queue again (which schedules the
+         * next flush if needed).
+         */
+        crm_info("Client %s caught up, sending %u held event%s as %u",
+                 crm_client_name(c), c->events_held, (c->events_held == 1)? "" : "s",
+                 g_list_length(held));
+        c->held_events = NULL;
+        c->events_held = 0;
+
+        /* The released events are a new backlog, not grounds for eviction */
+        c->queue_backlog = 0;
+
+        for (iter = held; iter != NULL; iter = iter->next) {
+            struct crm_ipcs_held_s *entry = iter->data;
+
+            if (entry->xml) {
+                crm_ipcs_send(c, 0, entry->xml, crm_ipc_server_event);
+
+            } else {
+                c->event_queue = g_list_append(c->event_queue, entry->iov);
+                entry->iov = NULL;
+            }
+        }
+        g_list_free_full(held, crm_ipcs_held_free);
+        return crm_ipcs_flush_events(c);
+    }
+
+    /* Events held behind merged ones are part of the backlog too, as are
+     * responses, which a client pipelining requests could otherwise leave
+     * us to buffer without limit
+     */
+    queue_len += g_list_length(c->held_events) + g_list_length(c->reply_queue);
+
     if (queue_len) {
 
         /* Allow clients to briefly fall behind on processing incoming messages,
@@ -584,7 +878,8 @@ crm_ipcs_flush_events(crm_client_t * c)
             if ((c->queue_backlog <= 1) || (queue_len < c->queue_backlog)) {
                 /* Don't evict for a new or shrinking backlog */
                 crm_warn("Client with process ID %u has a backlog of %u messages "
-                         CRM_XS " %p", c->pid, queue_len, c->ipcs);
+                         "(%u merged so far) " CRM_XS " %p",
+                         c->pid, queue_len, c->events_merged, c->ipcs);
             } else {
                 crm_err("Evicting client with process ID %u due to backlog of %u messages "
                          CRM_XS " %p", c->pid, queue_len, c->ipcs);
@@ -605,18 +900,46 @@ crm_ipcs_flush_events(crm_client_t * c)
     return rc;
 }
 
-ssize_t
-crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size)
+static ssize_t
+crm_ipc_prepare_adv(uint32_t request, xmlNode * message, struct iovec ** result,
+                    uint32_t max_send_size, uint32_t peer_flags)
 {
     static unsigned int biggest = 0;
     struct iovec *iov;
     unsigned int total = 0;
     char *compressed = NULL;
-    char *buffer = dump_xml_unformatted(message);
+    char *buffer = NULL;
+    size_t payload = 0;
     struct crm_ipc_response_header *header = calloc(1, sizeof(struct crm_ipc_response_header));
 
     CRM_ASSERT(result != NULL);
 
+    /* We can always decode binary messages, so let the other side know,
+     * along with whether we were built with lz4
+     */
+    header->flags |= crm_ipc_binary_ok;
+    if (crm_compression_supported(crm_compression_lz4)) {
+        header->flags |= crm_ipc_lz4_ok;
+    }
+
+    if (is_set(peer_flags, crm_ipc_binary_ok)) {
+        buffer = crm_xml_binary_encode(message, &payload);
+    }
+
+    if (buffer) {
+        header->flags |= crm_ipc_binary;
+
+    } else {
+        /* Size the message up front so it can be serialized straight into
+         * the buffer that becomes the payload iovec
+         */
+        payload = crm_xml_unformatted_size(message);
+        buffer = malloc(payload + 1);
+        CRM_ASSERT(buffer != NULL);
+        crm_xml_unformatted_write(message, buffer);
+        payload++;
+    }
+
     crm_ipc_init();
 
     if (max_send_size == 0) {
@@ -633,7 +956,7 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
     iov[0].iov_base = header;
 
     header->version = PCMK_IPC_VERSION;
-    header->size_uncompressed = 1 + strlen(buffer);
+    header->size_uncompressed = payload;
     total = iov[0].iov_len + header->size_uncompressed;
 
     if (total < max_send_size) {
@@ -642,9 +965,24 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
 
     } else {
         unsigned int new_size = 0;
+        enum crm_compression codec = crm_compression_bz2;
+
+        /* Prefer lz4 whenever both sides have it: it is an order of
+         * magnitude faster than bzip2 for only slightly larger output
+         */
+        if (is_set(peer_flags, crm_ipc_lz4_ok)
+            && crm_compression_supported(crm_compression_lz4)) {
+            codec = crm_compression_lz4;
+            header->flags |= crm_ipc_lz4;
+        }
 
-        if (crm_compress_string
-            (buffer, header->size_uncompressed, max_send_size, &compressed, &new_size)) {
+        /* Peers that can reassemble multipart messages have no size limit,
+         * but compression still reduces the number of parts
+         */
+        if (crm_compress_string_as(codec, buffer, header->size_uncompressed,
+                                   is_set(peer_flags, crm_ipc_multipart_ok)? 0 : max_send_size,
+                                   &compressed, &new_size)
+            && (new_size < header->size_uncompressed)) {
 
             header->flags |= crm_ipc_compressed;
             header->size_compressed = new_size;
@@ -656,6 +994,14 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
 
             biggest = QB_MAX(header->size_compressed, biggest);
 
+        } else if (is_set(peer_flags, crm_ipc_multipart_ok)) {
+            /* Incompressible, so send it as is */
+            free(compressed);
+            clear_bit(header->flags, crm_ipc_lz4);
+
+            iov[1].iov_base = buffer;
+            iov[1].iov_len = header->size_uncompressed;
+
         } else {
             ssize_t rc = -EMSGSIZE;
 
@@ -685,125 +1031,741 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
 }
 
 ssize_t
-crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
+crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size)
 {
-    ssize_t rc;
-    static uint32_t id = 1;
-    struct crm_ipc_response_header *header = iov[0].iov_base;
-
-    if (c->flags & crm_client_flag_ipc_proxied) {
-        /* _ALL_ replies to proxied connections need to be sent as events */
-        if (is_not_set(flags, crm_ipc_server_event)) {
-            flags |= crm_ipc_server_event;
-            /* this flag lets us know this was originally meant to be a response.
-             * even though we're sending it over the event channel. */
-            flags |= crm_ipc_proxied_relay_response;
-        }
-    }
+    return crm_ipc_prepare_adv(request, message, result, max_send_size, 0);
+}
 
-    header->flags |= flags;
-    if (flags & crm_ipc_server_event) {
-        header->qb.id = id++;   /* We don't really use it, but doesn't hurt to set one */
+/* A message published in the bulk area (kept in bulk.slots until reused) */
+struct crm_ipc_published_s {
+    uint32_t offset;        /* Where its slot is in the area */
+    uint32_t size;          /* Space used, including slot header and padding */
+    uint32_t generation;
+    unsigned int consumers; /* Clients that were sent a reference to it */
+};
 
-        if (flags & crm_ipc_server_free) {
-            crm_trace("Sending the original to %p[%d]", c->ipcs, c->pid);
-            c->event_queue = g_list_append(c->event_queue, iov);
+/* The process's shared bulk area, used by all of its IPC servers */
+static struct {
+    char *name;
+    char *map;
+    size_t size;
+    pid_t owner;            /* Forked children must leave the area alone */
+    unsigned int servers;   /* IPC servers that have been started */
+    uint32_t generation;
+    uint32_t head;          /* Where the next slot goes, if there is room */
+    GQueue *slots;          /* Published messages, oldest first */
+    crm_client_t *consumers[CRM_IPC_BULK_PUBLISHER];
+
+    unsigned long published;
+    unsigned long references;
+    unsigned long long bytes_referenced;
+    unsigned long full;
+} bulk;
+
+static inline struct crm_ipc_bulk_slot *
+crm_ipcs_bulk_slot(crm_ipc_published_t *published)
+{
+    return (struct crm_ipc_bulk_slot *)(void*)(bulk.map + published->offset);
+}
 
-        } else {
-            struct iovec *iov_copy = calloc(2, sizeof(struct iovec));
+static inline uint64_t
+crm_ipcs_bulk_pending(crm_ipc_published_t *published)
+{
+    return __sync_fetch_and_or(&(crm_ipcs_bulk_slot(published)->pending), 0);
+}
 
-            crm_trace("Sending a copy to %p[%d]", c->ipcs, c->pid);
-            iov_copy[0].iov_len = iov[0].iov_len;
-            iov_copy[0].iov_base = malloc(iov[0].iov_len);
-            memcpy(iov_copy[0].iov_base, iov[0].iov_base, iov[0].iov_len);
+static void
+crm_ipcs_bulk_unlink(void)
+{
+#ifdef HAVE_SHM_OPEN
+    if (bulk.name && (bulk.owner == getpid())) {
+        shm_unlink(bulk.name);
+    }
+#endif
+}
 
-            iov_copy[1].iov_len = iov[1].iov_len;
-            iov_copy[1].iov_base = malloc(iov[1].iov_len);
-            memcpy(iov_copy[1].iov_base, iov[1].iov_base, iov[1].iov_len);
+/*!
+ * \internal
+ * \brief Create the process's shared bulk area, if configured
+ *
+ * The size of the area comes from PCMK_ipc_bulk (in bytes, 0 to disable).
+ * It is created when the first IPC server starts, and removed when the last
+ * one is destroyed (or the process exits).
+ */
+void
+crm_ipcs_bulk_init(void)
+{
+#ifdef HAVE_SHM_OPEN
+    static bool registered = FALSE;
 
-            c->event_queue = g_list_append(c->event_queue, iov_copy);
-        }
+    int fd = -1;
+    int size = 0;
+    uid_t uid = 0;
+    gid_t gid = 0;
+    void *map = NULL;
 
-    } else {
-        CRM_LOG_ASSERT(header->qb.id != 0);     /* Replying to a specific request */
+    if (bulk.servers++ > 0) {
+        return;
+    }
 
-        rc = qb_ipcs_response_sendv(c->ipcs, iov, 2);
-        if (rc < header->qb.size) {
-            crm_notice("Response %d to %p[%d] (%u bytes) failed: %s (%d)",
-                       header->qb.id, c->ipcs, c->pid, header->qb.size, pcmk_strerror(rc), rc);
+    size = crm_parse_int(getenv("PCMK_ipc_bulk"), "0");
+    if (size <= 0) {
+        return;
+    }
+    size = QB_MAX(size, 4 * CRM_IPC_BULK_MIN);
 
-        } else {
-            crm_trace("Response %d sent, %lld bytes to %p[%d]",
-                      header->qb.id, (long long) rc, c->ipcs, c->pid);
-        }
+    bulk.name = crm_strdup_printf("/pacemaker-bulk-%lu", (unsigned long) getpid());
+    fd = shm_open(bulk.name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if ((fd < 0) && (errno == EEXIST)) {
+        /* Left behind by an earlier process with the same ID */
+        shm_unlink(bulk.name);
+        fd = shm_open(bulk.name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    }
+    if (fd < 0) {
+        crm_perror(LOG_WARNING, "Could not create shared IPC bulk area %s", bulk.name);
+        free(bulk.name);
+        bulk.name = NULL;
+        return;
+    }
 
-        if (flags & crm_ipc_server_free) {
-            free(iov[0].iov_base);
-            free(iov[1].iov_base);
-            free(iov);
-        }
+    /* Only privileged clients (root or the cluster user) are sent references,
+     * but the area belongs to the cluster group, like libqb's own buffers.
+     * Only we write to it: clients tell us by IPC when they're done reading.
+     */
+    if ((crm_user_lookup(CRM_DAEMON_USER, &uid, &gid) < 0) || (fchown(fd, -1, gid) < 0)) {
+        crm_perror(LOG_DEBUG, "Could not give group %u access to %s", gid, bulk.name);
     }
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP);
 
-    if (flags & crm_ipc_server_event) {
-        rc = crm_ipcs_flush_events(c);
+    if (ftruncate(fd, size) < 0) {
+        map = MAP_FAILED;
     } else {
-        crm_ipcs_flush_events(c);
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     }
+    close(fd);
 
-    if (rc == -EPIPE || rc == -ENOTCONN) {
-        crm_trace("Client %p disconnected", c->ipcs);
+    if (map == MAP_FAILED) {
+        crm_perror(LOG_WARNING, "Could not map shared IPC bulk area %s", bulk.name);
+        shm_unlink(bulk.name);
+        free(bulk.name);
+        bulk.name = NULL;
+        return;
     }
 
-    return rc;
+    bulk.map = map;
+    bulk.size = size;
+    bulk.head = 0;
+    bulk.owner = getpid();
+    bulk.slots = g_queue_new();
+
+    if (registered == FALSE) {
+        atexit(crm_ipcs_bulk_unlink);
+        registered = TRUE;
+    }
+    crm_info("Sharing large IPC messages with local clients via %s (%d bytes)",
+             bulk.name, size);
+#endif
 }
 
-ssize_t
-crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message,
-              enum crm_ipc_flags flags)
+/*!
+ * \internal
+ * \brief Remove the process's shared bulk area once no IPC servers are left
+ */
+void
+crm_ipcs_bulk_fini(void)
 {
-    struct iovec *iov = NULL;
-    ssize_t rc = 0;
-
-    if(c == NULL) {
-        return -EDESTADDRREQ;
+    if ((bulk.servers == 0) || (--bulk.servers > 0) || (bulk.map == NULL)) {
+        return;
     }
-    crm_ipc_init();
 
-    rc = crm_ipc_prepare(request, message, &iov, ipc_buffer_max);
-    if (rc > 0) {
-        rc = crm_ipcs_sendv(c, iov, flags | crm_ipc_server_free);
+    crm_info("Published %lu large IPC messages in %s (%lu references to %llu bytes), "
+             "area was full %lu times",
+             bulk.published, bulk.name, bulk.references, bulk.bytes_referenced, bulk.full);
 
-    } else {
-        free(iov);
-        crm_notice("Message to %p[%d] failed: %s (%d)",
-                   c->ipcs, c->pid, pcmk_strerror(rc), rc);
+    crm_ipcs_bulk_unlink();
+    munmap(bulk.map, bulk.size);
+    while (g_queue_is_empty(bulk.slots) == FALSE) {
+        free(g_queue_pop_head(bulk.slots));
     }
-
-    return rc;
+    g_queue_free(bulk.slots);
+    free(bulk.name);
+    memset(&bulk, 0, sizeof(bulk));
 }
 
-void
-crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags, const char *tag, const char *function,
-                  int line)
+/*!
+ * \internal
+ * \brief Check whether a client can be sent references to the bulk area
+ *
+ * \param[in,out] c  Client to check (assigned a consumer bit if needed)
+ *
+ * \return TRUE if references can be sent to \p c, FALSE otherwise
+ */
+static bool
+crm_ipcs_bulk_consumer(crm_client_t * c)
 {
-    if (flags & crm_ipc_client_response) {
-        xmlNode *ack = create_xml_node(NULL, tag);
+    int lpc = 0;
 
-        crm_trace("Ack'ing msg from %s (%p)", crm_client_name(c), c);
-        c->request_id = 0;
-        crm_xml_add(ack, "function", function);
-        crm_xml_add_int(ack, "line", line);
-        crm_ipcs_send(c, request, ack, flags);
-        free_xml(ack);
+    if ((bulk.map == NULL) || (c->kind != CRM_CLIENT_IPC)
+        || is_not_set(c->flags, crm_client_flag_ipc_bulk)
+        || is_not_set(c->flags, crm_client_flag_ipc_privileged)
+        || is_set(c->flags, crm_client_flag_ipc_proxied)) {
+        return FALSE;
+
+    } else if (c->bulk_consumer && (bulk.consumers[c->bulk_consumer - 1] == c)) {
+        return TRUE;
     }
-}
 
-/* Client... */
+    for (lpc = 0; lpc < CRM_IPC_BULK_PUBLISHER; lpc++) {
+        if (bulk.consumers[lpc] == NULL) {
+            bulk.consumers[lpc] = c;
+            c->bulk_consumer = lpc + 1;
+            return TRUE;
+        }
+    }
 
-#define MIN_MSG_SIZE    12336   /* sizeof(struct qb_ipc_connection_response) */
-#define MAX_MSG_SIZE    128*1024 /* 128k default */
+    /* Too many consumers already, so this one gets its messages as usual */
+    c->bulk_consumer = 0;
+    return FALSE;
+}
 
-struct crm_ipc_s {
+/*!
+ * \internal
+ * \brief Stop expecting a (departing) client to read anything in the bulk area
+ *
+ * \param[in,out] c  Client to forget
+ */
+static void
+crm_ipcs_bulk_forget(crm_client_t * c)
+{
+    GList *iter = NULL;
+    uint64_t bit = 0;
+    unsigned int consumer = c->bulk_consumer;
+
+    c->bulk_consumer = 0;
+    if ((consumer == 0) || (bulk.map == NULL) || (bulk.consumers[consumer - 1] != c)) {
+        return;
+    }
+
+    bulk.consumers[consumer - 1] = NULL;
+    bit = ((uint64_t) 1) << (consumer - 1);
+    for (iter = bulk.slots->head; iter != NULL; iter = iter->next) {
+        __sync_fetch_and_and(&(crm_ipcs_bulk_slot(iter->data)->pending), ~bit);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Note that a client has read a published message
+ *
+ * \param[in,out] c     Client that read it
+ * \param[in]     data  Reference the client was sent, as sent back by it
+ */
+static void
+crm_ipcs_bulk_ack(crm_client_t * c, const char *data)
+{
+    GList *iter = NULL;
+    struct crm_ipc_bulk_ref ref;
+
+    memcpy(&ref, data, sizeof(ref));
+    if ((bulk.map == NULL) || (c->bulk_consumer == 0)
+        || (bulk.consumers[c->bulk_consumer - 1] != c)
+        || (ref.consumer != (c->bulk_consumer - 1))) {
+        crm_debug("Ignoring bulk area acknowledgement from %s", crm_client_name(c));
+        return;
+    }
+
+    /* Only ever clear the client's own bit, and only in a live slot */
+    for (iter = bulk.slots->head; iter != NULL; iter = iter->next) {
+        crm_ipc_published_t *published = iter->data;
+
+        if ((published->offset == ref.offset) && (published->generation == ref.generation)) {
+            __sync_fetch_and_and(&(crm_ipcs_bulk_slot(published)->pending),
+                                 ~(((uint64_t) 1) << ref.consumer));
+            crm_trace("%s has read published message %u",
+                      crm_client_name(c), published->generation);
+            return;
+        }
+    }
+    crm_debug("%s acknowledged published message %u, which is no longer held",
+              crm_client_name(c), ref.generation);
+}
+
+/*!
+ * \internal
+ * \brief Find space in the bulk area for a new slot
+ *
+ * \param[in]  size    Space needed (a multiple of 8 bytes)
+ * \param[out] offset  Where the space starts
+ *
+ * \return TRUE if space was found, FALSE otherwise
+ */
+static bool
+crm_ipcs_bulk_alloc(uint32_t size, uint32_t *offset)
+{
+    crm_ipc_published_t *oldest = NULL;
+
+    /* Reuse the space of the oldest messages, once everyone has read them */
+    while (((oldest = g_queue_peek_head(bulk.slots)) != NULL)
+           && (crm_ipcs_bulk_pending(oldest) == 0)) {
+        free(g_queue_pop_head(bulk.slots));
+    }
+
+    if (oldest == NULL) {
+        bulk.head = 0;
+        if (size > bulk.size) {
+            return FALSE;
+        }
+        *offset = 0;
+
+    } else if (bulk.head > oldest->offset) {
+        /* Free space after the newest slot, and before the oldest */
+        if ((bulk.head + size) <= bulk.size) {
+            *offset = bulk.head;
+        } else if (size <= oldest->offset) {
+            *offset = 0;
+        } else {
+            return FALSE;
+        }
+
+    } else if ((bulk.head + size) <= oldest->offset) {
+        /* Wrapped around, so free space is between the newest and oldest */
+        *offset = bulk.head;
+
+    } else {
+        return FALSE;
+    }
+
+    bulk.head = *offset + size;
+    return TRUE;
+}
+
+/*!
+ * \brief Publish a prepared message in the shared bulk area
+ *
+ * Once published, crm_ipcs_sendv_published() sends capable local clients
+ * only a reference to the message, rather than a copy of it.
+ *
+ * \param[in] iov  Prepared message (as from crm_ipc_prepare())
+ *
+ * \return Published message (to be released with crm_ipcs_unpublish() once
+ *         it has been sent to everyone), or NULL if the message is small or
+ *         there is no bulk area (or no room in it)
+ * \note The caller still owns (and should still free) \p iov.
+ */
+crm_ipc_published_t *
+crm_ipcs_publish(struct iovec *iov)
+{
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    uint32_t size = 0;
+    struct crm_ipc_bulk_slot *slot = NULL;
+    crm_ipc_published_t *published = NULL;
+
+    if ((bulk.map == NULL) || (iov == NULL) || (iov[1].iov_len < CRM_IPC_BULK_MIN)) {
+        return NULL;
+    }
+
+    length = iov[0].iov_len + iov[1].iov_len;
+    size = (sizeof(struct crm_ipc_bulk_slot) + length + 7) & ~7;
+    if (crm_ipcs_bulk_alloc(size, &offset) == FALSE) {
+        do_crm_log((bulk.full++ == 0)? LOG_NOTICE : LOG_TRACE,
+                   "No room for %u byte message in %s, sending it as usual "
+                   "(consider a larger PCMK_ipc_bulk)", length, bulk.name);
+        return NULL;
+    }
+
+    published = calloc(1, sizeof(crm_ipc_published_t));
+    CRM_ASSERT(published != NULL);
+    published->offset = offset;
+    published->size = size;
+    published->generation = ++bulk.generation;
+
+    slot = crm_ipcs_bulk_slot(published);
+    slot->magic = CRM_IPC_BULK_MAGIC;
+    slot->generation = published->generation;
+    slot->length = length;
+    slot->padding = 0;
+    memcpy(slot + 1, iov[0].iov_base, iov[0].iov_len);
+    memcpy((char *) (slot + 1) + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+
+    /* Hold the slot until everyone it's for has been sent a reference */
+    slot->pending = ((uint64_t) 1) << CRM_IPC_BULK_PUBLISHER;
+    __sync_synchronize();
+
+    g_queue_push_tail(bulk.slots, published);
+    bulk.published++;
+    crm_trace("Published %u byte message %u at offset %u of %s",
+              length, published->generation, offset, bulk.name);
+    return published;
+}
+
+/*!
+ * \brief Release a published message once it has been sent to everyone
+ *
+ * \param[in] published  Message published with crm_ipcs_publish() (or NULL)
+ *
+ * \note The space is reused once every client sent a reference has
+ *       acknowledged reading it (or disconnected).
+ */
+void
+crm_ipcs_unpublish(crm_ipc_published_t *published)
+{
+    if (published) {
+        crm_trace("Published message %u was referenced by %u client%s",
+                  published->generation, published->consumers,
+                  (published->consumers == 1)? "" : "s");
+        __sync_fetch_and_and(&(crm_ipcs_bulk_slot(published)->pending),
+                             ~(((uint64_t) 1) << CRM_IPC_BULK_PUBLISHER));
+    }
+}
+
+/*!
+ * \brief Send a client a published message, or the message itself if it can't
+ *        read the bulk area
+ *
+ * \param[in] c          Client to send to
+ * \param[in] iov        Prepared message
+ * \param[in] published  \p iov as published with crm_ipcs_publish() (or NULL)
+ * \param[in] flags      Send flags, as for crm_ipcs_sendv()
+ *
+ * \return As for crm_ipcs_sendv()
+ */
+ssize_t
+crm_ipcs_sendv_published(crm_client_t * c, struct iovec *iov,
+                         crm_ipc_published_t *published, enum crm_ipc_flags flags)
+{
+    ssize_t rc = 0;
+    uint64_t bit = 0;
+    struct iovec *ref_iov = NULL;
+    struct crm_ipc_bulk_ref *ref = NULL;
+    struct crm_ipc_bulk_slot *slot = NULL;
+    struct crm_ipc_response_header *header = iov[0].iov_base;
+    struct crm_ipc_response_header *ref_header = NULL;
+
+    if ((published == NULL) || (crm_ipcs_bulk_consumer(c) == FALSE)
+        || (c->held_events && is_set(flags, crm_ipc_server_event))) {
+        /* Held events can outlive a slot, so they get a copy instead */
+        return crm_ipcs_sendv(c, iov, flags);
+    }
+
+    crm_ipc_init();
+
+    slot = crm_ipcs_bulk_slot(published);
+    bit = ((uint64_t) 1) << (c->bulk_consumer - 1);
+    __sync_fetch_and_or(&(slot->pending), bit);
+
+    ref = calloc(1, sizeof(struct crm_ipc_bulk_ref));
+    ref_header = calloc(1, hdr_offset);
+    ref_iov = calloc(2, sizeof(struct iovec));
+    CRM_ASSERT((ref != NULL) && (ref_header != NULL) && (ref_iov != NULL));
+
+    strncpy(ref->area, bulk.name, sizeof(ref->area) - 1);
+    ref->offset = published->offset;
+    ref->generation = published->generation;
+    ref->length = slot->length;
+    ref->consumer = c->bulk_consumer - 1;
+
+    ref_header->version = PCMK_IPC_VERSION;
+    ref_header->flags = crm_ipc_bulk;
+    ref_header->size_uncompressed = sizeof(struct crm_ipc_bulk_ref);
+    ref_header->qb.size = hdr_offset + sizeof(struct crm_ipc_bulk_ref);
+    ref_header->qb.id = header->qb.id;
+
+    ref_iov[0].iov_base = ref_header;
+    ref_iov[0].iov_len = hdr_offset;
+    ref_iov[1].iov_base = ref;
+    ref_iov[1].iov_len = sizeof(struct crm_ipc_bulk_ref);
+
+    published->consumers++;
+    bulk.references++;
+    bulk.bytes_referenced += ref->length;
+    crm_trace("Sending %p[%d] a reference to published message %u",
+              c->ipcs, c->pid, published->generation);
+
+    if (flags & crm_ipc_server_free) {
+        free(iov[0].iov_base);
+        free(iov[1].iov_base);
+        free(iov);
+    }
+
+    rc = crm_ipcs_sendv(c, ref_iov, flags | crm_ipc_server_free);
+    if ((rc < 0) && is_not_set(flags, crm_ipc_server_event)) {
+        /* The reference never made it, so don't wait for it to be read */
+        __sync_fetch_and_and(&(slot->pending), ~bit);
+    }
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Send a message that exceeds the IPC buffer size in several parts
+ *
+ * Every part carries a copy of the original header (so the receiver knows
+ * the full size up front) plus the crm_ipc_multipart flag, and the last
+ * part also has crm_ipc_multipart_end. Parts of one message are always
+ * sent (or queued) contiguously, so the receiver only needs to append them.
+ *
+ * \param[in] c      Client to send to
+ * \param[in] iov    Prepared message (header and payload)
+ * \param[in] flags  Send flags, as for crm_ipcs_sendv()
+ *
+ * \return Result of sending the last part attempted
+ */
+static ssize_t
+crm_ipcs_sendv_parts(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
+{
+    ssize_t rc = 0;
+    size_t offset = 0;
+    size_t chunk = ipc_buffer_max - hdr_offset - 1;
+    struct crm_ipc_response_header *header = iov[0].iov_base;
+
+    crm_debug("Sending %llu byte message %d to %p[%d] in %llu parts",
+              (unsigned long long) iov[1].iov_len, header->qb.id, c->ipcs, c->pid,
+              (unsigned long long) ((iov[1].iov_len + chunk - 1) / chunk));
+
+    while (offset < iov[1].iov_len) {
+        struct iovec *part = calloc(2, sizeof(struct iovec));
+        struct crm_ipc_response_header *part_header = malloc(hdr_offset);
+        size_t len = QB_MIN(chunk, iov[1].iov_len - offset);
+
+        CRM_ASSERT(part != NULL && part_header != NULL);
+        memcpy(part_header, header, hdr_offset);
+        part_header->flags |= crm_ipc_multipart;
+        if (offset + len == iov[1].iov_len) {
+            part_header->flags |= crm_ipc_multipart_end;
+        }
+        part_header->qb.size = hdr_offset + len;
+
+        part[0].iov_base = part_header;
+        part[0].iov_len = hdr_offset;
+        part[1].iov_base = malloc(len);
+        part[1].iov_len = len;
+        CRM_ASSERT(part[1].iov_base != NULL);
+        memcpy(part[1].iov_base, (char *) iov[1].iov_base + offset, len);
+
+        rc = crm_ipcs_sendv(c, part, flags | crm_ipc_server_free);
+        offset += len;
+
+        /* Parts that don't fit yet are queued, so a failure here means the
+         * response can't be completed; don't bother sending the rest of it
+         */
+        if (rc < 0 && is_not_set(flags, crm_ipc_server_event)) {
+            break;
+        }
+    }
+
+    if (flags & crm_ipc_server_free) {
+        free(iov[0].iov_base);
+        free(iov[1].iov_base);
+        free(iov);
+    }
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Copy a prepared message so it can be queued
+ */
+static struct iovec *
+crm_ipc_iov_copy(struct iovec *iov)
+{
+    struct iovec *iov_copy = calloc(2, sizeof(struct iovec));
+
+    CRM_ASSERT(iov_copy != NULL);
+    iov_copy[0].iov_len = iov[0].iov_len;
+    iov_copy[0].iov_base = malloc(iov[0].iov_len);
+    memcpy(iov_copy[0].iov_base, iov[0].iov_base, iov[0].iov_len);
+
+    iov_copy[1].iov_len = iov[1].iov_len;
+    iov_copy[1].iov_base = malloc(iov[1].iov_len);
+    memcpy(iov_copy[1].iov_base, iov[1].iov_base, iov[1].iov_len);
+    return iov_copy;
+}
+
+ssize_t
+crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
+{
+    ssize_t rc;
+    static uint32_t id = 1;
+    struct crm_ipc_response_header *header = iov[0].iov_base;
+
+    crm_ipc_init();
+
+    if (c->flags & crm_client_flag_ipc_proxied) {
+        /* _ALL_ replies to proxied connections need to be sent as events */
+        if (is_not_set(flags, crm_ipc_server_event)) {
+            flags |= crm_ipc_server_event;
+            /* this flag lets us know this was originally meant to be a response.
+             * even though we're sending it over the event channel. */
+            flags |= crm_ipc_proxied_relay_response;
+        }
+    }
+
+    if ((iov[1].iov_len >= CRM_IPC_BULK_MIN)
+        && is_not_set(header->flags, crm_ipc_bulk | crm_ipc_multipart)
+        && ((c->held_events == NULL) || is_not_set(flags, crm_ipc_server_event))
+        && crm_ipcs_bulk_consumer(c)) {
+        /* A single client still saves a copy, and queues only a reference */
+        crm_ipc_published_t *published = crm_ipcs_publish(iov);
+
+        if (published) {
+            rc = crm_ipcs_sendv_published(c, iov, published, flags);
+            crm_ipcs_unpublish(published);
+            return rc;
+        }
+    }
+
+    if (header->qb.size >= ipc_buffer_max
+        && is_set(c->flags, crm_client_flag_ipc_multipart)
+        && is_not_set(header->flags, crm_ipc_multipart)) {
+        return crm_ipcs_sendv_parts(c, iov, flags);
+    }
+
+    header->flags |= (flags & ~CRM_IPC_ENCODING_FLAGS);
+    if (flags & crm_ipc_server_event) {
+        header->qb.id = id++;   /* We don't really use it, but doesn't hurt to set one */
+
+        if (c->held_events) {
+            /* Don't let this overtake events held for a lagging client */
+            struct crm_ipcs_held_s *held = calloc(1, sizeof(struct crm_ipcs_held_s));
+
+            CRM_ASSERT(held != NULL);
+            crm_trace("Holding event %d for %p[%d]", header->qb.id, c->ipcs, c->pid);
+            held->iov = (flags & crm_ipc_server_free)? iov : crm_ipc_iov_copy(iov);
+            c->held_events = g_list_append(c->held_events, held);
+            c->events_held++;
+
+        } else if (flags & crm_ipc_server_free) {
+            crm_trace("Sending the original to %p[%d]", c->ipcs, c->pid);
+            c->event_queue = g_list_append(c->event_queue, iov);
+
+        } else {
+            crm_trace("Sending a copy to %p[%d]", c->ipcs, c->pid);
+            c->event_queue = g_list_append(c->event_queue, crm_ipc_iov_copy(iov));
+        }
+
+    } else {
+        CRM_LOG_ASSERT(header->qb.id != 0);     /* Replying to a specific request */
+
+        if (c->reply_queue == NULL) {
+            rc = qb_ipcs_response_sendv(c->ipcs, iov, 2);
+        } else {
+            /* Don't overtake (or split up) responses that are waiting */
+            rc = -EAGAIN;
+        }
+
+        if (rc == -EAGAIN) {
+            /* The client is still reading earlier replies (or parts of this
+             * one), which it may have many of in flight, so send this as it
+             * drains rather than drop it
+             */
+            crm_trace("Queueing response %d to %p[%d] (%u bytes)",
+                      header->qb.id, c->ipcs, c->pid, header->qb.size);
+            c->reply_queue = g_list_append(c->reply_queue,
+                                           (flags & crm_ipc_server_free)?
+                                           iov : crm_ipc_iov_copy(iov));
+            flags &= ~crm_ipc_server_free;
+            rc = header->qb.size;
+
+        } else if (rc < header->qb.size) {
+            crm_notice("Response %d to %p[%d] (%u bytes) failed: %s (%d)",
+                       header->qb.id, c->ipcs, c->pid, header->qb.size, pcmk_strerror(rc), rc);
+
+        } else {
+            crm_trace("Response %d sent, %lld bytes to %p[%d]",
+                      header->qb.id, (long long) rc, c->ipcs, c->pid);
+        }
+
+        if (flags & crm_ipc_server_free) {
+            free(iov[0].iov_base);
+            free(iov[1].iov_base);
+            free(iov);
+        }
+    }
+
+    if (flags & crm_ipc_server_event) {
+        rc = crm_ipcs_flush_events(c);
+    } else {
+        crm_ipcs_flush_events(c);
+    }
+
+    if (rc == -EPIPE || rc == -ENOTCONN) {
+        crm_trace("Client %p disconnected", c->ipcs);
+    }
+
+    return rc;
+}
+
+ssize_t
+crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message,
+              enum crm_ipc_flags flags)
+{
+    struct iovec *iov = NULL;
+    ssize_t rc = 0;
+    uint32_t peer_flags = 0;
+
+    if(c == NULL) {
+        return -EDESTADDRREQ;
+    }
+    crm_ipc_init();
+
+    /* Events (including all replies to proxied connections) are handed to
+     * client dispatch functions as text, so only replies can be binary
+     */
+    if (is_set(c->flags, crm_client_flag_ipc_binary)
+        && is_not_set(c->flags, crm_client_flag_ipc_proxied)
+        && is_not_set(flags, crm_ipc_server_event)) {
+        peer_flags |= crm_ipc_binary_ok;
+    }
+    if (is_set(c->flags, crm_client_flag_ipc_lz4)) {
+        peer_flags |= crm_ipc_lz4_ok;
+    }
+    if (is_set(c->flags, crm_client_flag_ipc_multipart)) {
+        peer_flags |= crm_ipc_multipart_ok;
+    }
+
+    rc = crm_ipc_prepare_adv(request, message, &iov, ipc_buffer_max, peer_flags);
+    if (rc > 0) {
+        rc = crm_ipcs_sendv(c, iov, flags | crm_ipc_server_free);
+
+    } else {
+        free(iov);
+        crm_notice("Message to %p[%d] failed: %s (%d)",
+                   c->ipcs, c->pid, pcmk_strerror(rc), rc);
+    }
+
+    return rc;
+}
+
+void
+crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags, const char *tag, const char *function,
+                  int line)
+{
+    if (flags & crm_ipc_client_response) {
+        xmlNode *ack = create_xml_node(NULL, tag);
+
+        crm_trace("Ack'ing msg from %s (%p)", crm_client_name(c), c);
+        c->request_id = 0;
+        crm_xml_add(ack, "function", function);
+        crm_xml_add_int(ack, "line", line);
+        crm_ipcs_send(c, request, ack, flags);
+        free_xml(ack);
+    }
+}
+
+/* Client... */
+
+#define MIN_MSG_SIZE    12336   /* sizeof(struct qb_ipc_connection_response) */
+#define MAX_MSG_SIZE    128*1024 /* 128k default */
+
+/* A multipart message being reassembled */
+struct crm_ipc_parts_s {
+    char *buffer;           /* Header of the first part, then the payload so far */
+    unsigned int size;      /* Size of the complete payload */
+    unsigned int offset;    /* Payload bytes received so far */
+};
+
+struct crm_ipc_s {
     struct pollfd pfd;
 
     /* the max size we can send/receive over ipc */
@@ -815,6 +1777,21 @@ struct crm_ipc_s {
     char *buffer;
     char *name;
     uint32_t buffer_flags;
+    uint32_t server_flags; /* Encodings the server advertised (crm_ipc_*_ok) */
+
+    /* Events and replies arrive on separate channels, so they may both
+     * be part way through a multipart message at the same time
+     */
+    struct crm_ipc_parts_s event_parts;
+    struct crm_ipc_parts_s reply_parts;
+
+    /* Requests in flight, by ID, with their replies once they arrive */
+    GHashTable *replies;
+
+    /* The server's shared bulk area, mapped when first referenced */
+    char *bulk_name;
+    char *bulk_map;
+    size_t bulk_size;
 
     qb_ipcc_connection_t *ipc;
 
@@ -873,6 +1850,10 @@ bool
 crm_ipc_connect(crm_ipc_t * client)
 {
     client->need_reply = FALSE;
+    if (client->replies) {
+        /* Nothing sent on a previous connection will be answered */
+        g_hash_table_remove_all(client->replies);
+    }
     client->ipc = qb_ipcc_connect(client->name, client->buf_size);
 
     if (client->ipc == NULL) {
@@ -915,6 +1896,18 @@ crm_ipc_close(crm_ipc_t * client)
     }
 }
 
+static void
+crm_ipc_bulk_unmap(crm_ipc_t * client)
+{
+    if (client->bulk_map) {
+        munmap(client->bulk_map, client->bulk_size);
+        client->bulk_map = NULL;
+        client->bulk_size = 0;
+    }
+    free(client->bulk_name);
+    client->bulk_name = NULL;
+}
+
 void
 crm_ipc_destroy(crm_ipc_t * client)
 {
@@ -932,6 +1925,12 @@ crm_ipc_destroy(crm_ipc_t * client)
             /* crm_ipc_close(client); */
         }
         crm_trace("Destroying IPC connection to %s: %p", client->name, client);
+        if (client->replies) {
+            g_hash_table_destroy(client->replies);
+        }
+        crm_ipc_bulk_unmap(client);
+        free(client->event_parts.buffer);
+        free(client->reply_parts.buffer);
         free(client->buffer);
         free(client->name);
         free(client);
@@ -1000,6 +1999,263 @@ crm_ipc_ready(crm_ipc_t *client)
     return (rc < 0)? -errno : rc;
 }
 
+/*!
+ * \internal
+ * \brief Add a newly received message to any multipart message in progress
+ *
+ * \param[in,out] client    Connection whose buffer holds the new message
+ * \param[in,out] parts     Reassembly state for the channel it arrived on
+ * \param[in]     msg_size  Size of the new message (including header)
+ *
+ * \return pcmk_ok if the connection's buffer now holds a complete message,
+ *         -EAGAIN if more parts are needed, -EBADMSG if parts were lost
+ */
+static int
+crm_ipc_gather(crm_ipc_t * client, struct crm_ipc_parts_s *parts, int msg_size)
+{
+    struct crm_ipc_response_header *header = (struct crm_ipc_response_header *)(void*)client->buffer;
+    unsigned int len = 0;
+
+    if (msg_size < hdr_offset) {
+        return pcmk_ok; /* Let the caller deal with it as before */
+
+    } else if (is_not_set(header->flags, crm_ipc_multipart)) {
+        if (parts->buffer) {
+            crm_warn("Discarding incomplete multipart message from %s (%u of %u bytes)",
+                     client->name, parts->offset, parts->size);
+            free(parts->buffer);
+            parts->buffer = NULL;
+        }
+        return pcmk_ok;
+    }
+
+    if (parts->buffer == NULL) {
+        /* Every part carries the header of the complete message */
+        parts->size = header->size_compressed? header->size_compressed : header->size_uncompressed;
+        parts->offset = 0;
+        parts->buffer = malloc(hdr_offset + parts->size + 1);
+        CRM_ASSERT(parts->buffer != NULL);
+        memcpy(parts->buffer, header, hdr_offset);
+    }
+
+    len = msg_size - hdr_offset;
+    if (len > parts->size - parts->offset) {
+        crm_err("Discarding corrupted multipart message from %s (%u + %u of %u bytes)",
+                client->name, parts->offset, len, parts->size);
+        free(parts->buffer);
+        parts->buffer = NULL;
+        return -EBADMSG;
+    }
+
+    memcpy(parts->buffer + hdr_offset + parts->offset, client->buffer + hdr_offset, len);
+    parts->offset += len;
+
+    if (is_not_set(header->flags, crm_ipc_multipart_end)) {
+        crm_trace("Received part of %s message (%u of %u bytes)",
+                  client->name, parts->offset, parts->size);
+        return -EAGAIN;
+
+    } else if (parts->offset != parts->size) {
+        crm_err("Discarding incomplete multipart message from %s (%u of %u bytes)",
+                client->name, parts->offset, parts->size);
+        free(parts->buffer);
+        parts->buffer = NULL;
+        return -EBADMSG;
+    }
+
+    /* Swap the reassembled message in as if it had arrived whole, keeping
+     * the buffer big enough for the next read
+     */
+    header = (struct crm_ipc_response_header *)(void*)parts->buffer;
+    clear_bit(header->flags, crm_ipc_multipart | crm_ipc_multipart_end);
+    header->qb.size = hdr_offset + parts->size;
+    client->msg_size = header->qb.size;
+
+    free(client->buffer);
+    client->buffer = parts->buffer;
+    client->buf_size = hdr_offset + parts->size + 1;
+    if (client->buf_size < client->max_buf_size) {
+        client->buffer = realloc_safe(client->buffer, client->max_buf_size);
+        client->buf_size = client->max_buf_size;
+    }
+    parts->buffer = NULL;
+
+    crm_trace("Reassembled %u byte %s message", parts->size, client->name);
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Map a server's shared bulk area, unless it already is
+ *
+ * \param[in,out] client  Connection to the server
+ * \param[in]     name    Name of the server's bulk area
+ *
+ * \return TRUE if the area is mapped, FALSE otherwise
+ */
+static bool
+crm_ipc_bulk_map(crm_ipc_t * client, const char *name)
+{
+#ifdef HAVE_SHM_OPEN
+    int fd = -1;
+    struct stat sb;
+    void *map = MAP_FAILED;
+
+    if (client->bulk_map && safe_str_eq(name, client->bulk_name)) {
+        return TRUE;
+    }
+    crm_ipc_bulk_unmap(client);
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        crm_perror(LOG_ERR, "Could not open %s shared bulk area %s", client->name, name);
+        return FALSE;
+    }
+    if ((fstat(fd, &sb) == 0) && (sb.st_size > 0)) {
+        map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        crm_perror(LOG_ERR, "Could not map %s shared bulk area %s", client->name, name);
+        return FALSE;
+    }
+
+    client->bulk_name = strdup(name);
+    client->bulk_map = map;
+    client->bulk_size = sb.st_size;
+    crm_debug("Mapped %s shared bulk area %s (%llu bytes)",
+              client->name, name, (unsigned long long) client->bulk_size);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Tell a server we have read a message from its shared bulk area
+ *
+ * \param[in] client  Connection to the server
+ * \param[in] ref     Reference we were sent
+ *
+ * \note This is not a request, so the server sends no reply.
+ */
+static void
+crm_ipc_bulk_ack(crm_ipc_t * client, struct crm_ipc_bulk_ref *ref)
+{
+    int rc = 0;
+    struct iovec iov[2];
+    struct crm_ipc_response_header header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = PCMK_IPC_VERSION;
+    header.flags = crm_ipc_bulk;
+    header.size_uncompressed = sizeof(struct crm_ipc_bulk_ref);
+    header.qb.size = hdr_offset + sizeof(struct crm_ipc_bulk_ref);
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = hdr_offset;
+    iov[1].iov_base = ref;
+    iov[1].iov_len = sizeof(struct crm_ipc_bulk_ref);
+
+    rc = internal_ipc_send_request(client, iov, 1000);
+    if (rc < 0) {
+        /* The server reclaims the space once we disconnect anyway */
+        crm_warn("Could not acknowledge %s message %u: %s",
+                 client->name, ref->generation, pcmk_strerror(rc));
+    }
+}
+
+/*!
+ * \internal
+ * \brief Replace a reference to a server's shared bulk area with the message
+ *
+ * \param[in,out] client  Connection whose buffer holds the new message
+ *
+ * \return pcmk_ok on success (or if the message isn't a reference),
+ *         -EBADMSG if the referenced message can't be read
+ */
+static int
+crm_ipc_bulk_resolve(crm_ipc_t * client)
+{
+    uint64_t bit = 0;
+    unsigned int size = 0;
+    unsigned int payload = 0;
+    char *buffer = NULL;
+    struct crm_ipc_bulk_ref ref;
+    struct crm_ipc_bulk_slot *slot = NULL;
+    struct crm_ipc_response_header *resolved = NULL;
+    struct crm_ipc_response_header *header = (struct crm_ipc_response_header *)(void*)client->buffer;
+
+    if ((client->msg_size < hdr_offset) || is_not_set(header->flags, crm_ipc_bulk)) {
+        return pcmk_ok;
+
+    } else if ((header->size_uncompressed != sizeof(ref))
+               || (client->msg_size < (hdr_offset + sizeof(ref)))) {
+        crm_err("Discarding malformed reference to %s shared bulk area", client->name);
+        return -EBADMSG;
+    }
+
+    memcpy(&ref, client->buffer + hdr_offset, sizeof(ref));
+    ref.area[sizeof(ref.area) - 1] = 0;
+    if (crm_ipc_bulk_map(client, ref.area) == FALSE) {
+        return -EBADMSG;
+    }
+
+    if ((ref.consumer >= CRM_IPC_BULK_PUBLISHER) || (ref.offset % 8) || (ref.length < hdr_offset)
+        || ((ref.offset + sizeof(struct crm_ipc_bulk_slot) + ref.length) > client->bulk_size)) {
+        crm_err("Discarding invalid reference to %s shared bulk area %s",
+                client->name, ref.area);
+        return -EBADMSG;
+    }
+
+    /* The area is mapped read-only, so just read the mask */
+    slot = (struct crm_ipc_bulk_slot *)(void*)(client->bulk_map + ref.offset);
+    bit = ((uint64_t) 1) << ref.consumer;
+    __sync_synchronize();
+    if ((slot->magic != CRM_IPC_BULK_MAGIC) || (slot->generation != ref.generation)
+        || (slot->length != ref.length)
+        || ((*(volatile uint64_t *) &(slot->pending) & bit) == 0)) {
+        crm_err("Discarding %s message %u: no longer in shared bulk area %s",
+                client->name, ref.generation, ref.area);
+        return -EBADMSG;
+    }
+
+    /* Copy it out and let the server reuse the space, keeping the buffer big
+     * enough for the next read
+     */
+    size = QB_MAX(ref.length + 1, client->max_buf_size);
+    buffer = malloc(size);
+    CRM_ASSERT(buffer != NULL);
+    memcpy(buffer, slot + 1, ref.length);
+    buffer[ref.length] = 0;
+    crm_ipc_bulk_ack(client, &ref);
+
+    resolved = (struct crm_ipc_response_header *)(void*)buffer;
+    payload = resolved->size_compressed? resolved->size_compressed : resolved->size_uncompressed;
+    if ((hdr_offset + payload) > ref.length) {
+        crm_err("Discarding %s message %u: corrupted in shared bulk area %s",
+                client->name, ref.generation, ref.area);
+        free(buffer);
+        return -EBADMSG;
+    }
+
+    /* The reference, not the original, carries the ID and send flags */
+    resolved->qb.id = header->qb.id;
+    resolved->qb.size = ref.length;
+    resolved->flags |= (header->flags & ~CRM_IPC_ENCODING_FLAGS);
+    client->msg_size = ref.length;
+
+    free(client->buffer);
+    client->buffer = buffer;
+    client->buf_size = size;
+
+    crm_trace("Read %u byte %s message %u from shared bulk area %s",
+              ref.length, client->name, ref.generation, ref.area);
+    return pcmk_ok;
+}
+
 static int
 crm_ipc_decompress(crm_ipc_t * client)
 {
@@ -1015,13 +2271,12 @@ crm_ipc_decompress(crm_ipc_t * client)
         crm_trace("Decompressing message data %u bytes into %u bytes",
                  header->size_compressed, size_u);
 
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed + hdr_offset, &size_u,
-                                        client->buffer + hdr_offset, header->size_compressed, 1, 0);
-
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %s (%d)", bz2_strerror(rc), rc);
+        rc = crm_decompress_string(crm_ipc_codec(header), client->buffer + hdr_offset,
+                                   header->size_compressed, uncompressed + hdr_offset,
+                                   &size_u);
+        if (rc != pcmk_ok) {
             free(uncompressed);
-            return -EILSEQ;
+            return rc;
         }
 
         /*
@@ -1042,13 +2297,17 @@ crm_ipc_decompress(crm_ipc_t * client)
         client->buffer = uncompressed;
     }
 
-    CRM_ASSERT(client->buffer[hdr_offset + header->size_uncompressed - 1] == 0);
+    client->server_flags |= header->flags & (crm_ipc_binary_ok | crm_ipc_lz4_ok);
+    if (is_not_set(header->flags, crm_ipc_binary)) {
+        CRM_ASSERT(client->buffer[hdr_offset + header->size_uncompressed - 1] == 0);
+    }
     return pcmk_ok;
 }
 
 long
 crm_ipc_read(crm_ipc_t * client)
 {
+    int rc = pcmk_ok;
     struct crm_ipc_response_header *header = NULL;
 
     CRM_ASSERT(client != NULL);
@@ -1058,9 +2317,25 @@ crm_ipc_read(crm_ipc_t * client)
     crm_ipc_init();
 
     client->buffer[0] = 0;
-    client->msg_size = qb_ipcc_event_recv(client->ipc, client->buffer, client->buf_size - 1, 0);
-    if (client->msg_size >= 0) {
-        int rc = crm_ipc_decompress(client);
+    do {
+        client->msg_size = qb_ipcc_event_recv(client->ipc, client->buffer, client->buf_size - 1, 0);
+        if (client->msg_size < 0) {
+            break;
+        }
+        /* Whatever part of a larger message is already waiting can be
+         * consumed now, the remainder is collected on later reads
+         */
+        rc = crm_ipc_gather(client, &client->event_parts, client->msg_size);
+    } while (rc == -EAGAIN);
+
+    if (rc == -EBADMSG) {
+        return rc;
+
+    } else if (client->msg_size >= 0) {
+        rc = crm_ipc_bulk_resolve(client);
+        if (rc == pcmk_ok) {
+            rc = crm_ipc_decompress(client);
+        }
 
         if (rc != pcmk_ok) {
             return rc;
@@ -1121,30 +2396,82 @@ crm_ipc_name(crm_ipc_t * client)
 }
 
 static int
-internal_ipc_send_recv(crm_ipc_t * client, const void *iov)
+internal_ipc_send_request(crm_ipc_t * client, const void *iov, int ms_timeout)
 {
     int rc = 0;
+    time_t timeout = time(NULL) + 1 + (ms_timeout / 1000);
 
     do {
-        rc = qb_ipcc_sendv_recv(client->ipc, iov, 2, client->buffer, client->buf_size, -1);
-    } while (rc == -EAGAIN && crm_ipc_connected(client));
+        rc = qb_ipcc_sendv(client->ipc, iov, 2);
+    } while (rc == -EAGAIN && (ms_timeout < 0 || time(NULL) < timeout)
+             && crm_ipc_connected(client));
 
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Receive the next complete reply on a connection
+ *
+ * \param[in,out] client      Connection to receive on
+ * \param[in]     ms_timeout  How long to wait for each part (-1 for ever)
+ *
+ * \return Size of the reply (now in the connection's buffer) on success,
+ *         -errno otherwise
+ */
 static int
-internal_ipc_send_request(crm_ipc_t * client, const void *iov, int ms_timeout)
+internal_ipc_recv_reply(crm_ipc_t * client, int ms_timeout)
 {
     int rc = 0;
-    time_t timeout = time(NULL) + 1 + (ms_timeout / 1000);
 
     do {
-        rc = qb_ipcc_sendv(client->ipc, iov, 2);
-    } while (rc == -EAGAIN && time(NULL) < timeout && crm_ipc_connected(client));
+        rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size, ms_timeout);
+        if (rc <= 0) {
+            return rc? rc : -ENOMSG;
+        }
+        client->msg_size = rc;
+        rc = crm_ipc_gather(client, &client->reply_parts, client->msg_size);
+    } while (rc == -EAGAIN);
 
+    if (rc == pcmk_ok) {
+        rc = crm_ipc_bulk_resolve(client);
+    }
+    if (rc == pcmk_ok) {
+        rc = crm_ipc_decompress(client);
+    }
+    if (rc == pcmk_ok) {
+        struct crm_ipc_response_header *hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
+
+        rc = hdr->qb.size;
+    }
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Keep the reply in a connection's buffer if a request is waiting for it
+ *
+ * \param[in,out] client  Connection whose buffer holds a reply
+ *
+ * \return TRUE if the reply was kept, FALSE if no request is waiting for it
+ */
+static bool
+internal_ipc_stash_reply(crm_ipc_t * client)
+{
+    struct crm_ipc_response_header *hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
+    gpointer key = GUINT_TO_POINTER((uint32_t) hdr->qb.id);
+
+    if (client->replies == NULL
+        || g_hash_table_lookup_extended(client->replies, key, NULL, NULL) == FALSE) {
+        return FALSE;
+    }
+
+    crm_trace("Keeping reply %d from %s until it is collected", hdr->qb.id, client->name);
+    g_hash_table_replace(client->replies, key,
+                         crm_ipc_payload_xml(hdr, crm_ipc_buffer(client)));
+    return TRUE;
+}
+
 static int
 internal_ipc_get_reply(crm_ipc_t * client, int request_id, int ms_timeout)
 {
@@ -1157,47 +2484,67 @@ internal_ipc_get_reply(crm_ipc_t * client, int request_id, int ms_timeout)
     crm_trace("client %s waiting on reply to msg id %d", client->name, request_id);
     do {
 
-        rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size, 1000);
+        rc = internal_ipc_recv_reply(client, 1000);
         if (rc > 0) {
-            struct crm_ipc_response_header *hdr = NULL;
-
-            int rc = crm_ipc_decompress(client);
+            struct crm_ipc_response_header *hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
 
-            if (rc != pcmk_ok) {
-                return rc;
-            }
-
-            hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
             if (hdr->qb.id == request_id) {
                 /* Got it */
-                break;
+                return rc;
+
+            } else if (internal_ipc_stash_reply(client)) {
+                /* Reply to another request in flight */
+
             } else if (hdr->qb.id < request_id) {
-                xmlNode *bad = string2xml(crm_ipc_buffer(client));
+                xmlNode *bad = crm_ipc_payload_xml(hdr, crm_ipc_buffer(client));
 
                 crm_err("Discarding old reply %d (need %d)", hdr->qb.id, request_id);
                 crm_log_xml_notice(bad, "OldIpcReply");
+                free_xml(bad);
 
             } else {
-                xmlNode *bad = string2xml(crm_ipc_buffer(client));
-
-                crm_err("Discarding newer reply %d (need %d)", hdr->qb.id, request_id);
-                crm_log_xml_notice(bad, "ImpossibleReply");
-                CRM_ASSERT(hdr->qb.id <= request_id);
+                xmlNode *bad = crm_ipc_payload_xml(hdr, crm_ipc_buffer(client));
+
+                /* With requests pipelined, this can be a late reply to one
+                 * we gave up on, so it's not worth dying over
+                 */
+                crm_err("Discarding unexpected reply %d (need %d)", hdr->qb.id, request_id);
+                crm_log_xml_notice(bad, "UnexpectedIpcReply");
+                free_xml(bad);
             }
         } else if (crm_ipc_connected(client) == FALSE) {
             crm_err("Server disconnected client %s while waiting for msg id %d", client->name,
                     request_id);
-            break;
+            return rc;
         }
 
-    } while (time(NULL) < timeout);
+    } while (ms_timeout < 0 || time(NULL) < timeout);
 
-    return rc;
+    /* Only replies to other requests arrived */
+    return (rc > 0)? -ETIMEDOUT : rc;
 }
 
+/*!
+ * \brief Send an IPC request without waiting for its reply
+ *
+ * Any number of requests may be in flight on a connection at once. If a
+ * reply is expected (crm_ipc_client_response), collect it by ID with
+ * crm_ipc_get_reply(); replies that arrive first are kept until then.
+ * Servers queue replies that don't fit in the connection's buffer, so none
+ * are lost however many are outstanding.
+ *
+ * \param[in]  client      Connection to send on
+ * \param[in]  message     Request to send
+ * \param[in]  flags       Bitmask of crm_ipc_flags
+ * \param[in]  ms_timeout  How long to keep retrying while the server is busy
+ *                         (0 for the default of 5s, -1 for ever)
+ * \param[out] request_id  If not NULL, where to store the request's ID
+ *
+ * \return Bytes sent on success, -errno otherwise
+ */
 int
-crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, int32_t ms_timeout,
-             xmlNode ** reply)
+crm_ipc_send_request(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags,
+                     int32_t ms_timeout, uint32_t * request_id)
 {
     long rc = 0;
     struct iovec *iov;
@@ -1223,7 +2570,10 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
 
     if (client->need_reply) {
         crm_trace("Trying again to obtain pending reply from %s", client->name);
-        rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size, ms_timeout);
+        do {
+            rc = internal_ipc_recv_reply(client, ms_timeout);
+        } while (rc > 0 && internal_ipc_stash_reply(client));
+
         if (rc < 0) {
             crm_warn("Sending to %s (%p) is disabled until pending reply is received", client->name,
                      client->ipc);
@@ -1236,15 +2586,34 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
         }
     }
 
+    /* Collect any replies that are already waiting, so that the server is
+     * never blocked behind a full reply channel while we keep sending
+     */
+    while (client->replies && g_hash_table_size(client->replies)
+           && internal_ipc_recv_reply(client, 0) > 0) {
+        if (internal_ipc_stash_reply(client) == FALSE) {
+            struct crm_ipc_response_header *hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
+
+            crm_warn("Discarding unexpected reply %d from %s", hdr->qb.id, client->name);
+        }
+    }
+
     id++;
     CRM_LOG_ASSERT(id != 0); /* Crude wrap-around detection */
-    rc = crm_ipc_prepare(id, message, &iov, client->max_buf_size);
+    rc = crm_ipc_prepare_adv(id, message, &iov, client->max_buf_size,
+                             client->server_flags);
     if(rc < 0) {
         return rc;
     }
 
     header = iov[0].iov_base;
-    header->flags |= flags;
+    header->flags |= (flags & ~CRM_IPC_ENCODING_FLAGS);
+
+    /* Let the server know it can send us more than fits in one buffer */
+    header->flags |= crm_ipc_multipart_ok;
+#ifdef HAVE_SHM_OPEN
+    header->flags |= crm_ipc_bulk_ok;
+#endif
 
     if(is_set(flags, crm_ipc_proxied)) {
         /* Don't look for a synchronous response */
@@ -1263,69 +2632,150 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
     crm_trace("Sending from client: %s request id: %d bytes: %u timeout:%d msg...",
               client->name, header->qb.id, header->qb.size, ms_timeout);
 
-    if (ms_timeout > 0 || is_not_set(flags, crm_ipc_client_response)) {
+    rc = internal_ipc_send_request(client, iov, ms_timeout);
 
-        rc = internal_ipc_send_request(client, iov, ms_timeout);
+    if (rc <= 0) {
+        crm_trace("Failed to send from client %s request %d with %u bytes...",
+                  client->name, header->qb.id, header->qb.size);
 
-        if (rc <= 0) {
-            crm_trace("Failed to send from client %s request %d with %u bytes...",
-                      client->name, header->qb.id, header->qb.size);
-            goto send_cleanup;
+    } else if (is_set(flags, crm_ipc_client_response)) {
+        if (client->replies == NULL) {
+            client->replies = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                    (GDestroyNotify) free_xml);
+        }
+        g_hash_table_insert(client->replies, GUINT_TO_POINTER(id), NULL);
 
-        } else if (is_not_set(flags, crm_ipc_client_response)) {
-            crm_trace("Message sent, not waiting for reply to %d from %s to %u bytes...",
-                      header->qb.id, client->name, header->qb.size);
+    } else {
+        crm_trace("Message sent, not waiting for reply to %d from %s to %u bytes...",
+                  header->qb.id, client->name, header->qb.size);
+    }
 
-            goto send_cleanup;
-        }
+    if (request_id) {
+        *request_id = id;
+    }
 
-        rc = internal_ipc_get_reply(client, header->qb.id, ms_timeout);
+    free(header);
+    free(iov[1].iov_base);
+    free(iov);
+    return rc;
+}
+
+/*!
+ * \brief Collect the reply to a request sent with crm_ipc_send_request()
+ *
+ * \param[in]  client      Connection the request was sent on
+ * \param[in]  request_id  ID of the request
+ * \param[in]  ms_timeout  How long to wait (0 for the default of 5s,
+ *                         -1 for ever)
+ * \param[out] reply       If not NULL, where to store the reply (which the
+ *                         caller must free with free_xml())
+ *
+ * \return pcmk_ok on success, -errno otherwise. If the reply did not arrive
+ *         in time, the request stays in flight and may be collected later.
+ */
+int
+crm_ipc_get_reply(crm_ipc_t * client, uint32_t request_id, int32_t ms_timeout,
+                  xmlNode ** reply)
+{
+    int rc = 0;
+    xmlNode *xml = NULL;
+    gpointer key = GUINT_TO_POINTER(request_id);
+
+    if (client == NULL) {
+        return -ENOTCONN;
+
+    } else if (client->replies == NULL
+               || g_hash_table_lookup_extended(client->replies, key, NULL,
+                                               (gpointer *) &xml) == FALSE) {
+        crm_err("No request %u to %s is waiting for a reply", request_id, client->name);
+        return -ENOMSG;
+    }
+
+    if (ms_timeout == 0) {
+        ms_timeout = 5000;
+    }
+
+    if (xml) {
+        /* Arrived while we were waiting for something else */
+        g_hash_table_steal(client->replies, key);
+
+    } else {
+        rc = internal_ipc_get_reply(client, request_id, ms_timeout);
         if (rc < 0) {
-            /* No reply, for now, disable sending
-             *
-             * The alternative is to close the connection since we don't know
-             * how to detect and discard out-of-sequence replies
-             *
-             * TODO - implement the above
-             */
-            client->need_reply = TRUE;
+            return rc;
         }
 
+        crm_trace("Received response %d, size=%u, rc=%d", request_id,
+                  ((struct crm_ipc_response_header *)(void*)client->buffer)->qb.size, rc);
+        xml = crm_ipc_payload_xml((struct crm_ipc_response_header *)(void*)client->buffer,
+                                  crm_ipc_buffer(client));
+        g_hash_table_remove(client->replies, key);
+    }
+
+    if (reply) {
+        *reply = xml;
     } else {
-        rc = internal_ipc_send_recv(client, iov);
+        free_xml(xml);
     }
+    return pcmk_ok;
+}
 
-    if (rc > 0) {
-        struct crm_ipc_response_header *hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
+int
+crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, int32_t ms_timeout,
+             xmlNode ** reply)
+{
+    long rc = 0;
+    long sent = 0;
+    uint32_t id = 0;
+
+    if (ms_timeout == 0) {
+        ms_timeout = 5000;
+    }
+    if(is_set(flags, crm_ipc_proxied)) {
+        /* Don't look for a synchronous response */
+        clear_bit(flags, crm_ipc_client_response);
+    }
 
-        crm_trace("Received response %d, size=%u, rc=%ld, text: %.200s", hdr->qb.id, hdr->qb.size,
-                  rc, crm_ipc_buffer(client));
+    sent = crm_ipc_send_request(client, message, flags, ms_timeout, &id);
+    rc = sent;
+    if (rc <= 0 || is_not_set(flags, crm_ipc_client_response)) {
+        goto send_cleanup;
+    }
 
-        if (reply) {
-            *reply = string2xml(crm_ipc_buffer(client));
-        }
+    rc = crm_ipc_get_reply(client, id, ms_timeout, reply);
+    if (rc < 0) {
+        /* No reply, for now, disable sending
+         *
+         * The alternative is to close the connection since we don't know
+         * how to detect and discard out-of-sequence replies
+         *
+         * TODO - implement the above
+         */
+        g_hash_table_remove(client->replies, GUINT_TO_POINTER(id));
+        client->need_reply = TRUE;
 
     } else {
-        crm_trace("Response not received: rc=%ld, errno=%d", rc, errno);
+        /* Callers expect a positive result on success */
+        rc = sent;
     }
 
   send_cleanup:
-    if (crm_ipc_connected(client) == FALSE) {
+    if (rc == -EALREADY || rc == -ENOTCONN || client == NULL) {
+        /* Already logged */
+
+    } else if (crm_ipc_connected(client) == FALSE) {
         crm_notice("Connection to %s closed: %s (%ld)", client->name, pcmk_strerror(rc), rc);
 
     } else if (rc == -ETIMEDOUT) {
-        crm_warn("Request %d to %s (%p) failed: %s (%ld) after %dms",
-                 header->qb.id, client->name, client->ipc, pcmk_strerror(rc), rc, ms_timeout);
+        crm_warn("Request %u to %s (%p) failed: %s (%ld) after %dms",
+                 id, client->name, client->ipc, pcmk_strerror(rc), rc, ms_timeout);
         crm_write_blackbox(0, NULL);
 
     } else if (rc <= 0) {
-        crm_warn("Request %d to %s (%p) failed: %s (%ld)",
-                 header->qb.id, client->name, client->ipc, pcmk_strerror(rc), rc);
+        crm_warn("Request %u to %s (%p) failed: %s (%ld)",
+                 id, client->name, client->ipc, pcmk_strerror(rc), rc);
     }
 
-    free(header);
-    free(iov[1].iov_base);
-    free(iov);
     return rc;
 }
 
@@ -612,6 +612,8 @@ mainloop_add_ipc_server(const char *name, enum qb_ipc_type type,
         return NULL;
     }
 
+    /* All of the process's servers share one bulk area */
+    crm_ipcs_bulk_init();
     return server;
 }
 
@@ -620,6 +622,7 @@ mainloop_del_ipc_server(qb_ipcs_service_t * server)
 {
     if (server) {
         qb_ipcs_destroy(server);
+        crm_ipcs_bulk_fini();
     }
 }
 
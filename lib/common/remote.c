@@ -39,6 +39,7 @@
 
 #include <crm/common/ipcs.h>
 #include <crm/common/xml.h>
+#include <crm/common/xml_internal.h>
 #include <crm/common/mainloop.h>
 
 #ifdef HAVE_GNUTLS_GNUTLS_H
@@ -336,22 +337,27 @@ crm_remote_send(crm_remote_t * remote, xmlNode * msg)
 {
     int rc = pcmk_ok;
     static uint64_t id = 0;
-    char *xml_text = dump_xml_unformatted(msg);
+    char *xml_text = NULL;
+    size_t payload = crm_xml_unformatted_size(msg);
 
     struct iovec iov[2];
     struct crm_remote_header_v0 *header;
 
-    if (xml_text == NULL) {
+    if (payload == 0) {
         crm_err("Could not send remote message: no message provided");
         return -EINVAL;
     }
 
+    xml_text = malloc(payload + 1);
+    CRM_ASSERT(xml_text != NULL);
+    crm_xml_unformatted_write(msg, xml_text);
+
     header = calloc(1, sizeof(struct crm_remote_header_v0));
     iov[0].iov_base = header;
     iov[0].iov_len = sizeof(struct crm_remote_header_v0);
 
     iov[1].iov_base = xml_text;
-    iov[1].iov_len = 1 + strlen(xml_text);
+    iov[1].iov_len = 1 + payload;
 
     id++;
     header->id = id;
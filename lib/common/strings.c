@@ -28,6 +28,10 @@
 #include <bzlib.h>
 #include <sys/types.h>
 
+#if HAVE_LZ4
+#  include <lz4.h>
+#endif
+
 char *
 crm_concat(const char *prefix, const char *suffix, char join)
 {
@@ -409,54 +413,182 @@ add_list_element(char *list, const char *value)
     return list;
 }
 
+const char *
+crm_compression_text(enum crm_compression codec)
+{
+    switch (codec) {
+        case crm_compression_none:
+            return "none";
+        case crm_compression_bz2:
+            return "bzip2";
+        case crm_compression_lz4:
+            return "lz4";
+    }
+    return "unknown";
+}
+
+/*!
+ * \internal
+ * \brief Check whether this build can compress and decompress with a codec
+ */
 bool
-crm_compress_string(const char *data, int length, int max, char **result, unsigned int *result_len)
+crm_compression_supported(enum crm_compression codec)
 {
-    int rc;
+    switch (codec) {
+        case crm_compression_bz2:
+            return TRUE;
+#if HAVE_LZ4
+        case crm_compression_lz4:
+            return TRUE;
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Compress a buffer
+ *
+ * \param[in]  codec       Compression to use
+ * \param[in]  data        Buffer to compress
+ * \param[in]  length      Size of \p data
+ * \param[in]  max         Fail if the result would be larger than this
+ *                         (0 for no limit)
+ * \param[out] result      Where to store the newly allocated result
+ * \param[out] result_len  Where to store the size of \p result
+ *
+ * \return TRUE on success, FALSE otherwise
+ */
+bool
+crm_compress_string_as(enum crm_compression codec, const char *data, int length,
+                       int max, char **result, unsigned int *result_len)
+{
+    int rc = 0;
     char *compressed = NULL;
-    char *uncompressed = strdup(data);
     struct timespec after_t;
     struct timespec before_t;
 
-    if(max == 0) {
-        max = (length * 1.1) + 600; /* recommended size */
-    }
-
 #ifdef CLOCK_MONOTONIC
     clock_gettime(CLOCK_MONOTONIC, &before_t);
 #endif
 
-    /* coverity[returned_null] Ignore */
-    compressed = malloc(max);
-
-    *result_len = max;
-    rc = BZ2_bzBuffToBuffCompress(compressed, result_len, uncompressed, length, CRM_BZ2_BLOCKS, 0,
-                                  CRM_BZ2_WORK);
-
-    free(uncompressed);
+    switch (codec) {
+        case crm_compression_bz2:
+            if(max == 0) {
+                max = (length * 1.1) + 600; /* recommended size */
+            }
+
+            /* coverity[returned_null] Ignore */
+            compressed = malloc(max);
+
+            /* The input may be binary, so it can't be copied with strdup()
+             * (bzip2 does not modify it in any case)
+             */
+            *result_len = max;
+            rc = BZ2_bzBuffToBuffCompress(compressed, result_len, (char *) data, length,
+                                          CRM_BZ2_BLOCKS, 0, CRM_BZ2_WORK);
+
+            if (rc != BZ_OK) {
+                crm_err("Compression of %d bytes failed: %s (%d)", length, bz2_strerror(rc), rc);
+                free(compressed);
+                return FALSE;
+            }
+            break;
+
+#if HAVE_LZ4
+        case crm_compression_lz4:
+            if(max == 0 || max > LZ4_compressBound(length)) {
+                max = LZ4_compressBound(length);
+            }
+
+            compressed = malloc(max);
+            CRM_ASSERT(compressed != NULL);
+
+            rc = LZ4_compress_default(data, compressed, length, max);
+            if (rc <= 0) {
+                crm_err("Compression of %d bytes into at most %d failed", length, max);
+                free(compressed);
+                return FALSE;
+            }
+            *result_len = rc;
+            break;
+#endif
 
-    if (rc != BZ_OK) {
-        crm_err("Compression of %d bytes failed: %s (%d)", length, bz2_strerror(rc), rc);
-        free(compressed);
-        return FALSE;
+        default:
+            crm_err("Compression with %s is not supported", crm_compression_text(codec));
+            return FALSE;
     }
 
 #ifdef CLOCK_MONOTONIC
     clock_gettime(CLOCK_MONOTONIC, &after_t);
 
-    crm_trace("Compressed %d bytes into %d (ratio %d:1) in %.0fms",
-             length, *result_len, length / (*result_len),
-             difftime (after_t.tv_sec, before_t.tv_sec) * 1000 +
-             (after_t.tv_nsec - before_t.tv_nsec) / 1e6);
+    crm_debug("Compressed %d bytes into %d with %s (ratio %.1f:1) in %.0fms",
+              length, *result_len, crm_compression_text(codec),
+              length / (double) (*result_len),
+              difftime (after_t.tv_sec, before_t.tv_sec) * 1000 +
+              (after_t.tv_nsec - before_t.tv_nsec) / 1e6);
 #else
-    crm_trace("Compressed %d bytes into %d (ratio %d:1)",
-             length, *result_len, length / (*result_len));
+    crm_debug("Compressed %d bytes into %d with %s (ratio %.1f:1)",
+              length, *result_len, crm_compression_text(codec),
+              length / (double) (*result_len));
 #endif
 
     *result = compressed;
     return TRUE;
 }
 
+bool
+crm_compress_string(const char *data, int length, int max, char **result, unsigned int *result_len)
+{
+    return crm_compress_string_as(crm_compression_bz2, data, length, max, result, result_len);
+}
+
+/*!
+ * \internal
+ * \brief Decompress a buffer
+ *
+ * \param[in]     codec       Compression that was used
+ * \param[in]     data        Compressed data
+ * \param[in]     length      Size of \p data
+ * \param[out]    result      Where to decompress to
+ * \param[in,out] result_len  Size of \p result on input, of the
+ *                            decompressed data on output
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+crm_decompress_string(enum crm_compression codec, const char *data, unsigned int length,
+                      char *result, unsigned int *result_len)
+{
+    int rc = 0;
+
+    switch (codec) {
+        case crm_compression_bz2:
+            rc = BZ2_bzBuffToBuffDecompress(result, result_len, (char *) data, length, 1, 0);
+            if (rc != BZ_OK) {
+                crm_err("Decompression failed: %s (%d)", bz2_strerror(rc), rc);
+                return -EILSEQ;
+            }
+            return pcmk_ok;
+
+#if HAVE_LZ4
+        case crm_compression_lz4:
+            rc = LZ4_decompress_safe(data, result, length, *result_len);
+            if (rc < 0) {
+                crm_err("Decompression of %u lz4 bytes failed (%d)", length, rc);
+                return -EILSEQ;
+            }
+            *result_len = rc;
+            return pcmk_ok;
+#endif
+
+        default:
+            crm_err("Decompression with %s is not supported", crm_compression_text(codec));
+            return -EPROTONOSUPPORT;
+    }
+}
+
 /*!
  * \brief Compare two strings alphabetically (case-insensitive)
  *
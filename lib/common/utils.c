@@ -1197,9 +1197,9 @@ void cib_ipc_servers_destroy(qb_ipcs_service_t *ipcs_ro,
         qb_ipcs_service_t *ipcs_rw,
         qb_ipcs_service_t *ipcs_shm)
 {
-    qb_ipcs_destroy(ipcs_ro);
-    qb_ipcs_destroy(ipcs_rw);
-    qb_ipcs_destroy(ipcs_shm);
+    mainloop_del_ipc_server(ipcs_ro);
+    mainloop_del_ipc_server(ipcs_rw);
+    mainloop_del_ipc_server(ipcs_shm);
 }
 
 qb_ipcs_service_t *
@@ -32,6 +32,7 @@
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/xml_internal.h>  /* CRM_XML_LOG_BASE */
+#include <md5.h>
 
 #if HAVE_BZLIB_H
 #  include <bzlib.h>
@@ -81,13 +82,40 @@ typedef struct xml_private_s
         char *user;
         GListPtr acls;
         GListPtr deleted_objs;
+        unsigned char *digest; /* Cached subtree digest, NULL if stale */
+        GHashTable *children_by_id; /* Element children by name and id, for wide nodes */
+        GHashTable *attrs_by_name; /* Attributes by name, for wide elements */
+        GHashTable *indexed_by; /* Parent's index that refers to us */
+        char *index_key;
+        struct xml_private_slab_s *slab; /* Where we were allocated from */
 } xml_private_t;
 
 typedef struct xml_acl_s {
         enum xml_private_flags mode;
         char *xpath;
+        bool simple; /* Built from tag/ref/attribute, testable without XPath */
+        char *tag;
+        char *ref;
+        char *attr;
 } xml_acl_t;
 
+/* Compiled ACL rules for one user, valid while the ACL section is unchanged */
+typedef struct xml_acl_rules_s {
+        unsigned char digest[MD5_DIGEST_SIZE];
+        GListPtr acls;
+} xml_acl_rules_t;
+
+/* Most recent filtered view of a CIB for one user */
+typedef struct xml_acl_view_s {
+        unsigned char digest[2 * MD5_DIGEST_SIZE];
+        xmlNode *result;
+} xml_acl_view_t;
+
+#define XML_ACL_CACHE_MAX 64
+static GHashTable *acl_rule_cache = NULL;
+static GHashTable *acl_xpath_cache = NULL;
+static GHashTable *acl_view_cache = NULL;
+
 typedef struct xml_deleted_obj_s {
         char *path;
         int position;
@@ -186,11 +214,45 @@ set_doc_flag(xmlNode *xml, long flag)
     }
 }
 
+/*!
+ * \internal
+ * \brief Discard the cached subtree digests of a node and its ancestors
+ *
+ * A cached digest is only ever valid if those of all its descendants are,
+ * so we can stop at the first ancestor without one.  The node itself may
+ * have only just been linked in, so its own state says nothing about its
+ * ancestors.
+ *
+ * \param[in] xml  Node whose content (or that of a descendant) changed
+ */
+static void
+__xml_digest_invalidate(xmlNode *xml)
+{
+    bool first = TRUE;
+
+    for(; xml && xml->type != XML_DOCUMENT_NODE; xml = xml->parent) {
+        xml_private_t *p = xml->_private;
+
+        if(p == NULL) {
+            /* During calls to xmlDocCopyNode(), _private will be unset for parent nodes */
+
+        } else if(p->digest) {
+            free(p->digest);
+            p->digest = NULL;
+
+        } else if(first == FALSE) {
+            break;
+        }
+        first = FALSE;
+    }
+}
+
 static void
 __xml_node_dirty(xmlNode *xml) 
 {
     set_doc_flag(xml, xpf_dirty);
     set_parent_flag(xml, xpf_dirty);
+    __xml_digest_invalidate(xml);
 }
 
 static void
@@ -278,10 +340,48 @@ __xml_acl_free(void *data)
         xml_acl_t *acl = data;
 
         free(acl->xpath);
+        free(acl->tag);
+        free(acl->ref);
+        free(acl->attr);
         free(acl);
     }
 }
 
+#if ENABLE_ACL
+static xml_acl_t *
+__xml_acl_copy(const xml_acl_t *acl)
+{
+    xml_acl_t *copy = calloc(1, sizeof(xml_acl_t));
+
+    CRM_ASSERT(copy != NULL);
+    copy->mode = acl->mode;
+    copy->simple = acl->simple;
+    copy->xpath = acl->xpath? strdup(acl->xpath) : NULL;
+    copy->tag = acl->tag? strdup(acl->tag) : NULL;
+    copy->ref = acl->ref? strdup(acl->ref) : NULL;
+    copy->attr = acl->attr? strdup(acl->attr) : NULL;
+    return copy;
+}
+
+static void
+__xml_acl_rules_free(void *data)
+{
+    xml_acl_rules_t *rules = data;
+
+    g_list_free_full(rules->acls, __xml_acl_free);
+    free(rules);
+}
+#endif
+
+static void
+__xml_acl_view_free(void *data)
+{
+    xml_acl_view_t *view = data;
+
+    free_xml(view->result);
+    free(view);
+}
+
 static void
 __xml_deleted_obj_free(void *data)
 {
@@ -315,16 +415,341 @@ __xml_private_clean(xml_private_t *p)
 }
 
 
+/* Nodes with at least this many children get an index of them by name and id,
+ * so that patchsets against wide sections (such as status) can find their
+ * targets without walking every sibling
+ */
+#define XML_CHILD_INDEX_MIN 32
+
+static char *
+__xml_index_key(const char *name, const char *id)
+{
+    return crm_strdup_printf("%s[@id='%s']", name, id);
+}
+
+/*!
+ * \internal
+ * \brief Remove a node from its parent's child index (if any)
+ */
+static void
+__xml_index_forget(xmlNode *child)
+{
+    xml_private_t *p = child->_private;
+
+    if(p && p->indexed_by) {
+        g_hash_table_remove(p->indexed_by, p->index_key);
+        p->indexed_by = NULL;
+        free(p->index_key);
+        p->index_key = NULL;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add a node to its parent's child index (if the parent has one)
+ *
+ * \note The first child with a given name and id wins, as with a linear search
+ */
+static void
+__xml_index_add(xmlNode *parent, xmlNode *child)
+{
+    char *key = NULL;
+    xml_private_t *p = parent->_private;
+    xml_private_t *cp = child->_private;
+
+    if(p == NULL || p->children_by_id == NULL || cp == NULL
+       || child->type != XML_ELEMENT_NODE || ID(child) == NULL) {
+        return;
+    }
+
+    __xml_index_forget(child);
+    key = __xml_index_key((const char *)child->name, ID(child));
+    if(g_hash_table_lookup(p->children_by_id, key)) {
+        free(key);
+        return;
+    }
+
+    cp->index_key = key;
+    cp->indexed_by = p->children_by_id;
+    g_hash_table_insert(p->children_by_id, key, child);
+}
+
+static gboolean
+__xml_index_release(gpointer key, gpointer value, gpointer user_data)
+{
+    xml_private_t *cp = ((xmlNode *) value)->_private;
+
+    /* The key belongs to the child */
+    cp->indexed_by = NULL;
+    free(cp->index_key);
+    cp->index_key = NULL;
+    return TRUE;
+}
+
+static void
+__xml_index_free(xml_private_t *p)
+{
+    if(p && p->children_by_id) {
+        g_hash_table_foreach_remove(p->children_by_id, __xml_index_release, NULL);
+        g_hash_table_destroy(p->children_by_id);
+        p->children_by_id = NULL;
+    }
+}
+
+/* Elements with at least this many attributes get an index of them by name,
+ * since the likes of lrm_rsc_op are queried for many attributes in turn
+ */
+#define XML_ATTR_INDEX_MIN 8
+
+/*!
+ * \internal
+ * \brief Add an attribute to its element's attribute index (if it has one)
+ */
+static void
+__xml_attr_index_add(xmlNode *xml, xmlAttr *attr)
+{
+    xml_private_t *p = xml->_private;
+    xml_private_t *ap = attr->_private;
+
+    if(p == NULL || p->attrs_by_name == NULL || ap == NULL) {
+        return;
+    }
+
+    __xml_index_forget((xmlNode *) attr);
+    if(g_hash_table_lookup(p->attrs_by_name, attr->name)) {
+        return;
+    }
+
+    ap->index_key = strdup((const char *)attr->name);
+    ap->indexed_by = p->attrs_by_name;
+    g_hash_table_insert(p->attrs_by_name, ap->index_key, attr);
+}
+
+static void
+__xml_attr_index_free(xml_private_t *p)
+{
+    if(p && p->attrs_by_name) {
+        g_hash_table_foreach_remove(p->attrs_by_name, __xml_index_release, NULL);
+        g_hash_table_destroy(p->attrs_by_name);
+        p->attrs_by_name = NULL;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Find an attribute of an element by name
+ *
+ * Equivalent to xmlHasProp() without DTD defaults, but indexes the attributes
+ * of wide elements the first time one is looked up.  Attributes keep the index
+ * current as they are created and freed (see pcmkRegisterNode()).
+ */
+static xmlAttr *
+__xml_attr_find(xmlNode *xml, const char *name)
+{
+    int scanned = 0;
+    xmlAttr *attr = NULL;
+    xml_private_t *p = NULL;
+
+    if(xml->type != XML_ELEMENT_NODE) {
+        return NULL;
+    }
+
+    p = xml->_private;
+    if(p && p->attrs_by_name) {
+        return g_hash_table_lookup(p->attrs_by_name, name);
+    }
+
+    for (attr = xml->properties; attr != NULL; attr = attr->next, scanned++) {
+        if (strcmp((const char *)attr->name, name) == 0) {
+            break;
+        }
+    }
+
+    if(p && scanned >= XML_ATTR_INDEX_MIN) {
+        xmlAttr *aIter = NULL;
+
+        p->attrs_by_name = g_hash_table_new(crm_str_hash, g_str_equal);
+        for (aIter = xml->properties; aIter != NULL; aIter = aIter->next) {
+            __xml_attr_index_add(xml, aIter);
+        }
+    }
+    return attr;
+}
+
+static void
+__xml_index_build(xmlNode *parent)
+{
+    xmlNode *cIter = NULL;
+    xml_private_t *p = parent->_private;
+
+    if(p == NULL) {
+        return;
+    }
+
+    __xml_index_free(p);
+    p->children_by_id = g_hash_table_new(crm_str_hash, g_str_equal);
+    for (cIter = __xml_first_child(parent); cIter != NULL; cIter = __xml_next(cIter)) {
+        __xml_index_add(parent, cIter);
+    }
+}
+
+/* Every element, attribute and comment needs an xml_private_t, so they are
+ * carved out of slabs rather than malloc'd individually.  Nodes move between
+ * documents and have no document yet when registered, so the slabs are shared
+ * by the whole process rather than kept per document.
+ */
+#define XML_PRIVATE_SLAB_SIZE 256
+
+typedef struct xml_private_slab_s {
+        struct xml_private_slab_s *prev; /* Slabs with free entries */
+        struct xml_private_slab_s *next;
+        xml_private_t *free_list; /* Linked via the slab field */
+        unsigned int used;
+        xml_private_t entries[XML_PRIVATE_SLAB_SIZE];
+} xml_private_slab_t;
+
+static xml_private_slab_t *private_slabs = NULL;
+static unsigned int private_slabs_empty = 0;
+
+static struct xml_private_stats_s {
+        unsigned long allocs;
+        unsigned long slab_allocs;
+        unsigned long slab_frees;
+        unsigned long in_use;
+        unsigned long peak;
+} private_stats = { 0, };
+
+static void
+__xml_slab_link(xml_private_slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = private_slabs;
+    if(private_slabs) {
+        private_slabs->prev = slab;
+    }
+    private_slabs = slab;
+}
+
+static void
+__xml_slab_unlink(xml_private_slab_t *slab)
+{
+    if(slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        private_slabs = slab->next;
+    }
+    if(slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+static xml_private_t *
+__xml_private_alloc(void)
+{
+    xml_private_t *p = NULL;
+    xml_private_slab_t *slab = private_slabs;
+
+    if(slab == NULL) {
+        int lpc = 0;
+
+        slab = malloc(sizeof(xml_private_slab_t));
+        CRM_ASSERT(slab != NULL);
+
+        slab->used = 0;
+        slab->free_list = NULL;
+        for(lpc = XML_PRIVATE_SLAB_SIZE - 1; lpc >= 0; lpc--) {
+            slab->entries[lpc].slab = (xml_private_slab_t *) slab->free_list;
+            slab->free_list = &(slab->entries[lpc]);
+        }
+        __xml_slab_link(slab);
+        private_slabs_empty++;
+        private_stats.slab_allocs++;
+    }
+
+    p = slab->free_list;
+    slab->free_list = (xml_private_t *) p->slab;
+    if(slab->used++ == 0) {
+        private_slabs_empty--;
+    }
+    if(slab->free_list == NULL) {
+        __xml_slab_unlink(slab);
+    }
+
+    memset(p, 0, sizeof(xml_private_t));
+    p->slab = slab;
+
+    private_stats.allocs++;
+    private_stats.in_use++;
+    private_stats.peak = QB_MAX(private_stats.peak, private_stats.in_use);
+    return p;
+}
+
+static void
+__xml_private_release(xml_private_t *p)
+{
+    xml_private_slab_t *slab = p->slab;
+
+    CRM_ASSERT(slab != NULL);
+    p->check = 0;
+    if(slab->free_list == NULL) {
+        __xml_slab_link(slab);
+    }
+    p->slab = (xml_private_slab_t *) slab->free_list;
+    slab->free_list = p;
+    private_stats.in_use--;
+
+    if(--slab->used == 0) {
+        /* Keep one empty slab around so a node being repeatedly created and
+         * freed doesn't malloc and free a whole slab each time
+         */
+        if(private_slabs_empty > 0) {
+            __xml_slab_unlink(slab);
+            free(slab);
+            private_stats.slab_frees++;
+        } else {
+            private_slabs_empty++;
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Report how many private structures have been needed, and how many
+ *        slab (and hence malloc) calls provided them
+ *
+ * \param[out] allocs  Number of xml_private_t allocations so far
+ * \param[out] slabs   Number of slabs allocated so far
+ */
+void
+crm_xml_private_stats(unsigned long *allocs, unsigned long *slabs)
+{
+    *allocs = private_stats.allocs;
+    *slabs = private_stats.slab_allocs;
+}
+
 static void
 __xml_private_free(xml_private_t *p)
 {
     __xml_private_clean(p);
-    free(p);
+    if(p) {
+        __xml_index_free(p);
+        __xml_attr_index_free(p);
+        free(p->digest);
+        __xml_private_release(p);
+    }
 }
 
 static void
 pcmkDeregisterNode(xmlNodePtr node)
 {
+    /* Depending on the libxml2 version, children may be freed before or
+     * after their parent, so both sides of the index unhook themselves
+     */
+    if(node->_private) {
+        __xml_index_forget(node);
+    }
     __xml_private_free(node->_private);
 }
 
@@ -338,11 +763,16 @@ pcmkRegisterNode(xmlNodePtr node)
         case XML_DOCUMENT_NODE:
         case XML_ATTRIBUTE_NODE:
         case XML_COMMENT_NODE:
-            p = calloc(1, sizeof(xml_private_t));
+            p = __xml_private_alloc();
             p->check = XML_PRIVATE_MAGIC;
             /* Flags will be reset if necessary when tracking is enabled */
             p->flags |= (xpf_dirty|xpf_created);
             node->_private = p;
+
+            /* New attributes are already attached to their element by now */
+            if(node->type == XML_ATTRIBUTE_NODE && node->parent) {
+                __xml_attr_index_add(node->parent, (xmlAttr *) node);
+            }
             break;
         case XML_TEXT_NODE:
         case XML_DTD_NODE:
@@ -408,6 +838,11 @@ __xml_acl_create(xmlNode * xml, xmlNode *target, enum xml_private_flags mode)
             int offset = 0;
             char buffer[XML_BUFFER_SIZE];
 
+            acl->simple = TRUE;
+            acl->tag = tag? strdup(tag) : NULL;
+            acl->ref = ref? strdup(ref) : NULL;
+            acl->attr = attr? strdup(attr) : NULL;
+
             if(tag) {
                 offset += snprintf(buffer + offset, XML_BUFFER_SIZE - offset, "//%s", tag);
             } else {
@@ -536,12 +971,96 @@ __xml_acl_to_text(enum xml_private_flags flags)
     return "none";
 }
 
+/*!
+ * \internal
+ * \brief Evaluate an ACL's XPath against the document containing \p xml
+ *
+ * Expressions are compiled once and kept for the life of the process, since
+ * the same handful of rules is evaluated on every request.
+ */
+static xmlXPathObjectPtr
+__xml_acl_search(xmlNode *xml, xml_acl_t *acl)
+{
+    xmlXPathObjectPtr xpathObj = NULL;
+    xmlXPathContextPtr xpathCtx = NULL;
+    xmlXPathCompExprPtr expr = NULL;
+
+    if(acl_xpath_cache == NULL) {
+        acl_xpath_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                                (GDestroyNotify) xmlXPathFreeCompExpr);
+    }
+
+    expr = g_hash_table_lookup(acl_xpath_cache, acl->xpath);
+    if(expr == NULL) {
+        expr = xmlXPathCompile((const xmlChar *) acl->xpath);
+        if(expr == NULL) {
+            crm_err("Invalid ACL xpath: %s", acl->xpath);
+            return NULL;
+        }
+        if(g_hash_table_size(acl_xpath_cache) >= XML_ACL_CACHE_MAX) {
+            g_hash_table_remove_all(acl_xpath_cache);
+        }
+        g_hash_table_insert(acl_xpath_cache, strdup(acl->xpath), expr);
+    }
+
+    xpathCtx = xmlXPathNewContext(xml->doc);
+    CRM_ASSERT(xpathCtx != NULL);
+
+    xpathObj = xmlXPathCompiledEval(expr, xpathCtx);
+    xmlXPathFreeContext(xpathCtx);
+    return xpathObj;
+}
+
+static inline bool
+__xml_acl_simple_match(xml_acl_t *acl, xmlNode *xml)
+{
+    if(acl->tag && strcmp(acl->tag, (const char *)xml->name) != 0) {
+        return FALSE;
+    }
+    if(acl->ref && safe_str_neq(acl->ref, ID(xml))) {
+        return FALSE;
+    }
+    if(acl->attr && xmlHasProp(xml, (const xmlChar *)acl->attr) == NULL) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Apply all tag/ref/attribute based ACLs in a single pass over \p xml
+ */
+static void
+__xml_acl_apply_simple(xmlNode *xml, GListPtr acls)
+{
+    GListPtr aIter = NULL;
+    xmlNode *cIter = NULL;
+    xml_private_t *p = xml->_private;
+
+    for(aIter = acls; aIter != NULL; aIter = aIter->next) {
+        xml_acl_t *acl = aIter->data;
+
+        if(acl->simple && __xml_acl_simple_match(acl, xml)) {
+            crm_trace("Applying %x to %s[@id=%s] for %s",
+                      acl->mode, crm_element_name(xml), ID(xml), acl->xpath);
+            p->flags |= acl->mode;
+        }
+    }
+
+    for (cIter = __xml_first_child(xml); cIter != NULL; cIter = __xml_next(cIter)) {
+        if(cIter->type == XML_ELEMENT_NODE) {
+            __xml_acl_apply_simple(cIter, acls);
+        }
+    }
+}
+
 static void
 __xml_acl_apply(xmlNode *xml) 
 {
     GListPtr aIter = NULL;
     xml_private_t *p = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
+    bool have_simple = FALSE;
 
     if(xml_acl_enabled(xml) == FALSE) {
         p = xml->doc->_private;
@@ -554,7 +1073,17 @@ __xml_acl_apply(xmlNode *xml)
         int max = 0, lpc = 0;
         xml_acl_t *acl = aIter->data;
 
-        xpathObj = xpath_search(xml, acl->xpath);
+#ifndef SUSE_ACL_COMPAT
+        /* Rule order only matters for SUSE compatibility, so otherwise the
+         * simple rules can all be handled by one walk of the tree below
+         */
+        if(acl->simple) {
+            have_simple = TRUE;
+            continue;
+        }
+#endif
+
+        xpathObj = __xml_acl_search(xml, acl);
         max = numXpathResults(xpathObj);
 
         for(lpc = 0; lpc < max; lpc++) {
@@ -584,6 +1113,11 @@ __xml_acl_apply(xmlNode *xml)
         freeXpathObject(xpathObj);
     }
 
+    if(have_simple) {
+        p = xml->doc->_private;
+        __xml_acl_apply_simple(xmlDocGetRootElement(xml->doc), p->acls);
+    }
+
     p = xml->_private;
     if(is_not_set(p->flags, xpf_acl_read) && is_not_set(p->flags, xpf_acl_write)) {
         p->flags |= xpf_acl_deny;
@@ -608,19 +1142,44 @@ __xml_acl_unpack(xmlNode *source, xmlNode *target, const char *user)
         crm_trace("no acls needed for '%s'", user);
 
     } else if(p->acls == NULL) {
+        GListPtr aIter = NULL;
+        xml_acl_rules_t *rules = NULL;
+        unsigned char digest[MD5_DIGEST_SIZE];
         xmlNode *acls = get_xpath_object("//"XML_CIB_TAG_ACLS, source, LOG_TRACE);
 
         free(p->user);
         p->user = strdup(user);
 
+        /* The rules only depend on the ACL section, whose digest is cached
+         * until something in it changes
+         */
+        memset(digest, 0, MD5_DIGEST_SIZE);
         if(acls) {
-            xmlNode *child = NULL;
+            crm_xml_merkle_digest(acls, FALSE, digest);
+        }
 
-            for (child = __xml_first_child(acls); child; child = __xml_next(child)) {
-                const char *tag = crm_element_name(child);
+        if(acl_rule_cache == NULL) {
+            acl_rule_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                                   __xml_acl_rules_free);
+        }
 
-                if (strcmp(tag, XML_ACL_TAG_USER) == 0 || strcmp(tag, XML_ACL_TAG_USERv1) == 0) {
-                    const char *id = crm_element_value(child, XML_ATTR_ID);
+        rules = g_hash_table_lookup(acl_rule_cache, user);
+        if(rules && memcmp(rules->digest, digest, MD5_DIGEST_SIZE) == 0) {
+            crm_trace("Using compiled ACLs for %s", user);
+            for(aIter = rules->acls; aIter != NULL; aIter = aIter->next) {
+                p->acls = g_list_append(p->acls, __xml_acl_copy(aIter->data));
+            }
+            return;
+        }
+
+        if(acls) {
+            xmlNode *child = NULL;
+
+            for (child = __xml_first_child(acls); child; child = __xml_next(child)) {
+                const char *tag = crm_element_name(child);
+
+                if (strcmp(tag, XML_ACL_TAG_USER) == 0 || strcmp(tag, XML_ACL_TAG_USERv1) == 0) {
+                    const char *id = crm_element_value(child, XML_ATTR_ID);
 
                     if(id && strcmp(id, user) == 0) {
                         crm_debug("Unpacking ACLs for %s", id);
@@ -629,6 +1188,17 @@ __xml_acl_unpack(xmlNode *source, xmlNode *target, const char *user)
                 }
             }
         }
+
+        if(g_hash_table_size(acl_rule_cache) >= XML_ACL_CACHE_MAX) {
+            g_hash_table_remove_all(acl_rule_cache);
+        }
+        rules = calloc(1, sizeof(xml_acl_rules_t));
+        CRM_ASSERT(rules != NULL);
+        memcpy(rules->digest, digest, MD5_DIGEST_SIZE);
+        for(aIter = p->acls; aIter != NULL; aIter = aIter->next) {
+            rules->acls = g_list_append(rules->acls, __xml_acl_copy(aIter->data));
+        }
+        g_hash_table_replace(acl_rule_cache, strdup(user), rules);
     }
 #endif
 }
@@ -682,6 +1252,7 @@ __xml_purge_attributes(xmlNode *xml)
 
         xmlUnsetProp(xml, tmp->name);
     }
+    __xml_digest_invalidate(xml);
 
     child = __xml_first_child(xml);
     while ( child != NULL ) {
@@ -697,24 +1268,18 @@ __xml_purge_attributes(xmlNode *xml)
     return readable_children;
 }
 
-bool
-xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNode ** result)
+static void
+__xml_acl_filter(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNode ** result)
 {
     GListPtr aIter = NULL;
     xmlNode *target = NULL;
     xml_private_t *p = NULL;
     xml_private_t *doc = NULL;
 
-    *result = NULL;
-    if(xml == NULL || pcmk_acl_required(user) == FALSE) {
-        crm_trace("no acls needed for '%s'", user);
-        return FALSE;
-    }
-
     crm_trace("filtering copy of %p for '%s'", xml, user);
     target = copy_xml(xml);
     if(target == NULL) {
-        return TRUE;
+        return;
     }
 
     __xml_acl_unpack(acl_source, target, user);
@@ -731,7 +1296,7 @@ xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNo
 
         } else if(acl->xpath) {
             int lpc = 0;
-            xmlXPathObjectPtr xpathObj = xpath_search(target, acl->xpath);
+            xmlXPathObjectPtr xpathObj = __xml_acl_search(target, acl);
 
             max = numXpathResults(xpathObj);
             for(lpc = 0; lpc < max; lpc++) {
@@ -741,7 +1306,7 @@ xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNo
                 if(__xml_purge_attributes(match) == FALSE && match == target) {
                     crm_trace("No access to the entire document for %s", user);
                     freeXpathObject(xpathObj);
-                    return TRUE;
+                    return;
                 }
             }
             crm_trace("Enforced ACL %s (%d matches)", acl->xpath, max);
@@ -752,7 +1317,7 @@ xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNo
     p = target->_private;
     if(is_set(p->flags, xpf_acl_deny) && __xml_purge_attributes(target) == FALSE) {
         crm_trace("No access to the entire document for %s", user);
-        return TRUE;
+        return;
     }
 
     if(doc->acls) {
@@ -768,7 +1333,60 @@ xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNo
     if(target) {
         *result = target;
     }
+}
+
+/*!
+ * \brief Create a copy of \p xml containing only what \p user may read
+ *
+ * The last filtered view is kept for each user and reused until the
+ * digest of \p xml (which includes its version) or \p acl_source changes.
+ *
+ * \return FALSE if \p user needs no filtering, TRUE otherwise (in which case
+ *         \p result is NULL if \p user may not read anything)
+ */
+bool
+xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNode ** result)
+{
+    xml_acl_view_t *view = NULL;
+    unsigned char digest[2 * MD5_DIGEST_SIZE];
+
+    *result = NULL;
+    if(xml == NULL || pcmk_acl_required(user) == FALSE) {
+        crm_trace("no acls needed for '%s'", user);
+        return FALSE;
+    }
+
+    crm_xml_merkle_digest(xml, FALSE, digest);
+    if(acl_source && acl_source != xml) {
+        crm_xml_merkle_digest(acl_source, FALSE, digest + MD5_DIGEST_SIZE);
+    } else {
+        memset(digest + MD5_DIGEST_SIZE, 0, MD5_DIGEST_SIZE);
+    }
+
+    if(acl_view_cache == NULL) {
+        acl_view_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                               __xml_acl_view_free);
+    }
+
+    view = g_hash_table_lookup(acl_view_cache, user);
+    if(view && memcmp(view->digest, digest, sizeof(digest)) == 0) {
+        crm_trace("Using cached view of %p for '%s'", xml, user);
+        if(view->result) {
+            *result = copy_xml(view->result);
+        }
+        return TRUE;
+    }
+
+    __xml_acl_filter(user, acl_source, xml, result);
 
+    if(g_hash_table_size(acl_view_cache) >= XML_ACL_CACHE_MAX) {
+        g_hash_table_remove_all(acl_view_cache);
+    }
+    view = calloc(1, sizeof(xml_acl_view_t));
+    CRM_ASSERT(view != NULL);
+    memcpy(view->digest, digest, sizeof(digest));
+    view->result = *result? copy_xml(*result) : NULL;
+    g_hash_table_replace(acl_view_cache, strdup(user), view);
     return TRUE;
 }
 
@@ -801,6 +1419,7 @@ __xml_acl_post_process(xmlNode * xml)
                 crm_trace("Cannot add new node %s at %s", crm_element_name(xml), path);
 
                 if(xml != xmlDocGetRootElement(xml->doc)) {
+                    __xml_digest_invalidate(xml->parent);
                     xmlUnlinkNode(xml);
                     xmlFreeNode(xml);
                 }
@@ -1193,6 +1812,7 @@ xml_repair_v1_diff(xmlNode * last, xmlNode * next, xmlNode * local_diff, gboolea
 
             xmlSetProp(cib, (const xmlChar *)p_name, (const xmlChar *)p_value);
         }
+        __xml_digest_invalidate(cib);
     }
 
     crm_log_xml_explicit(local_diff, "Repaired-diff");
@@ -1921,9 +2541,28 @@ xml_apply_patchset_v1(xmlNode *xml, xmlNode *patchset)
 static xmlNode *
 __first_xml_child_match(xmlNode *parent, const char *name, const char *id, int position)
 {
+    int scanned = 0;
     xmlNode *cIter = NULL;
+    xml_private_t *p = parent->_private;
+
+    if(id && p && p->children_by_id) {
+        char *key = __xml_index_key(name, id);
+
+        cIter = g_hash_table_lookup(p->children_by_id, key);
+        free(key);
+
+        /* Children added or changed outside the XML API aren't indexed,
+         * so only hits that still check out can be trusted
+         */
+        if(cIter && cIter->parent == parent
+           && strcmp((const char *)cIter->name, name) == 0
+           && safe_str_eq(ID(cIter), id)) {
+            return cIter;
+        }
+    }
 
     for (cIter = __xml_first_child(parent); cIter != NULL; cIter = __xml_next(cIter)) {
+        scanned++;
         if(strcmp((const char *)cIter->name, name) != 0) {
             continue;
         } else if(id) {
@@ -1940,9 +2579,14 @@ __first_xml_child_match(xmlNode *parent, const char *name, const char *id, int p
             continue;
         }
 
-        return cIter;
+        break;
     }
-    return NULL;
+
+    if(id && scanned >= XML_CHILD_INDEX_MIN) {
+        /* Wide node with a missing or stale index */
+        __xml_index_build(parent);
+    }
+    return cIter;
 }
 
 static xmlNode *
@@ -2080,6 +2724,8 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                 xmlAddChild(match, child);
             }
             crm_node_created(child);
+            __xml_index_add(match, child);
+            __xml_digest_invalidate(match);
 
         } else if(strcmp(op, "move") == 0) {
             int position = 0;
@@ -2111,6 +2757,7 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                     CRM_ASSERT(match->parent->last != NULL);
                     xmlAddNextSibling(match->parent->last, match);
                 }
+                __xml_digest_invalidate(match->parent);
 
             } else {
                 crm_trace("%s is already in position %d", match->name, position);
@@ -2412,6 +3059,8 @@ add_node_copy(xmlNode * parent, xmlNode * src_node)
     child = xmlDocCopyNode(src_node, doc, 1);
     xmlAddChild(parent, child);
     crm_node_created(child);
+    __xml_index_add(parent, child);
+    __xml_digest_invalidate(parent);
     return child;
 }
 
@@ -2526,6 +3175,8 @@ crm_xml_add(xmlNode * node, const char *name, const char *value)
     attr = xmlSetProp(node, (const xmlChar *)name, (const xmlChar *)value);
     if(dirty) {
         crm_attr_dirty(attr);
+    } else {
+        __xml_digest_invalidate(node);
     }
 
     CRM_CHECK(attr && attr->children && attr->children->content, return NULL);
@@ -2569,6 +3220,8 @@ crm_xml_replace(xmlNode * node, const char *name, const char *value)
     attr = xmlSetProp(node, (const xmlChar *)name, (const xmlChar *)value);
     if(dirty) {
         crm_attr_dirty(attr);
+    } else {
+        __xml_digest_invalidate(node);
     }
     CRM_CHECK(attr && attr->children && attr->children->content, return NULL);
     return (char *)attr->children->content;
@@ -2604,6 +3257,7 @@ create_xml_node(xmlNode * parent, const char *name)
         doc = getDocPtr(parent);
         node = xmlNewDocRawNode(doc, NULL, (const xmlChar *)name, NULL);
         xmlAddChild(parent, node);
+        __xml_digest_invalidate(parent);
     }
     crm_node_created(node);
     return node;
@@ -2695,6 +3349,7 @@ free_xml_with_position(xmlNode * child, int position)
             /* Free this particular subtree
              * Make sure to unlink it from the parent first
              */
+            __xml_digest_invalidate(child->parent);
             xmlUnlinkNode(child);
             xmlFreeNode(child);
         }
@@ -3176,30 +3831,115 @@ add_message_xml(xmlNode * msg, const char *field, xmlNode * xml)
     return TRUE;
 }
 
-static char *
-crm_xml_escape_shuffle(char *text, int start, int *length, const char *replace)
+/*!
+ * \internal
+ * \brief Get the escape sequence crm_xml_escape() uses for a character
+ *
+ * \param[in]  c      Character to check
+ * \param[out] octal  Scratch space for octal escapes (at least 16 bytes)
+ *
+ * \return Replacement text, or NULL if \p c needs no escaping
+ */
+static inline const char *
+__xml_escape_char(char c, char *octal)
+{
+    switch (c) {
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '"':
+            return "&quot;";
+        case '\'':
+            return "&apos;";
+        case '&':
+            return "&amp;";
+        case '\t':
+            return "    ";
+        case '\n':
+            return "\\n";
+        case '\r':
+            return "\\r";
+        default:
+            if(c < ' ' || c > '~') {
+                snprintf(octal, 16, "\\%.3o", c);
+                return octal;
+            }
+    }
+    return NULL;
+}
+
+/* Escaped length of each byte value, 1 if it needs no escaping */
+static unsigned char escape_len[256] = { 0, };
+
+static void
+__xml_escape_init(void)
 {
     int lpc;
-    int offset = strlen(replace) - 1;   /* We have space for 1 char already */
+    char octal[16];
 
-    *length += offset;
-    text = realloc_safe(text, *length);
+    for (lpc = 1; lpc < 256; lpc++) {
+        const char *replace = __xml_escape_char((char) lpc, octal);
 
-    for (lpc = (*length) - 1; lpc > (start + offset); lpc--) {
-        text[lpc] = text[lpc - offset];
+        escape_len[lpc] = replace? strlen(replace) : 1;
     }
+    escape_len[0] = 1;
+}
 
-    memcpy(text + start, replace, offset + 1);
-    return text;
+static size_t
+__xml_escaped_len(const char *text)
+{
+    size_t len = 0;
+    const unsigned char *c = (const unsigned char *) text;
+
+    if (escape_len[0] == 0) {
+        __xml_escape_init();
+    }
+    for (; *c != 0; c++) {
+        len += escape_len[*c];
+    }
+    return len;
+}
+
+static char *
+__xml_escaped_write(const char *text, char *out)
+{
+    char octal[16];
+    const unsigned char *c = (const unsigned char *) text;
+
+    if (escape_len[0] == 0) {
+        __xml_escape_init();
+    }
+
+    while (*c != 0) {
+        const unsigned char *start = c;
+
+        /* Copy runs that need no escaping in one go */
+        while (*c != 0 && escape_len[*c] == 1) {
+            c++;
+        }
+        if (c > start) {
+            memcpy(out, start, c - start);
+            out += c - start;
+        }
+
+        if (*c != 0) {
+            const char *replace = __xml_escape_char((char) *c, octal);
+
+            memcpy(out, replace, escape_len[*c]);
+            out += escape_len[*c];
+            c++;
+        }
+    }
+    return out;
 }
 
 char *
 crm_xml_escape(const char *text)
 {
-    int index;
-    int changes = 0;
-    int length = 1 + strlen(text);
-    char *copy = strdup(text);
+    char *copy = NULL;
+    size_t len = strlen(text);
+    size_t escaped = __xml_escaped_len(text);
 
     /*
      * When xmlCtxtReadDoc() parses &lt; and friends in a
@@ -3216,63 +3956,14 @@ crm_xml_escape(const char *text)
      * when necessary.
      */
 
-    for (index = 0; index < length; index++) {
-        switch (copy[index]) {
-            case 0:
-                break;
-            case '<':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&lt;");
-                changes++;
-                break;
-            case '>':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&gt;");
-                changes++;
-                break;
-            case '"':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&quot;");
-                changes++;
-                break;
-            case '\'':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&apos;");
-                changes++;
-                break;
-            case '&':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&amp;");
-                changes++;
-                break;
-            case '\t':
-                /* Might as well just expand to a few spaces... */
-                copy = crm_xml_escape_shuffle(copy, index, &length, "    ");
-                changes++;
-                break;
-            case '\n':
-                /* crm_trace("Convert: \\%.3o", copy[index]); */
-                copy = crm_xml_escape_shuffle(copy, index, &length, "\\n");
-                changes++;
-                break;
-            case '\r':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "\\r");
-                changes++;
-                break;
-                /* For debugging...
-            case '\\':
-                crm_trace("Passthrough: \\%c", copy[index+1]);
-                break;
-                */
-            default:
-                /* Check for and replace non-printing characters with their octal equivalent */
-                if(copy[index] < ' ' || copy[index] > '~') {
-                    char *replace = crm_strdup_printf("\\%.3o", copy[index]);
-
-                    /* crm_trace("Convert to octal: \\%.3o", copy[index]); */
-                    copy = crm_xml_escape_shuffle(copy, index, &length, replace);
-                    free(replace);
-                    changes++;
-                }
-        }
-    }
+    copy = malloc(escaped + 1);
+    CRM_ASSERT(copy != NULL);
+
+    if (escaped == len) {
+        memcpy(copy, text, len + 1);
 
-    if (changes) {
+    } else {
+        *__xml_escaped_write(text, copy) = 0;
         crm_trace("Dumped '%s'", copy);
     }
     return copy;
@@ -3281,7 +3972,10 @@ crm_xml_escape(const char *text)
 static inline void
 dump_xml_attr(xmlAttrPtr attr, int options, char **buffer, int *offset, int *max)
 {
-    char *p_value = NULL;
+    char *out = NULL;
+    size_t needed = 0;
+    size_t name_len = 0;
+    const char *p_value = NULL;
     const char *p_name = NULL;
     xml_private_t *p = NULL;
 
@@ -3296,9 +3990,29 @@ dump_xml_attr(xmlAttrPtr attr, int options, char **buffer, int *offset, int *max
     }
 
     p_name = (const char *)attr->name;
-    p_value = crm_xml_escape((const char *)attr->children->content);
-    buffer_print(*buffer, *max, *offset, " %s=\"%s\"", p_name, p_value);
-    free(p_value);
+    p_value = (const char *)attr->children->content;
+    if (p_value == NULL) {
+        p_value = "";
+    }
+
+    /* Escape straight into the buffer rather than via a temporary copy */
+    name_len = strlen(p_name);
+    needed = 4 + name_len + __xml_escaped_len(p_value);
+    while (*buffer == NULL || needed >= (size_t) ((*max) - (*offset))) {
+        (*max) = QB_MAX(CHUNK_SIZE, (*max) * 2);
+        (*buffer) = realloc_safe((*buffer), (*max));
+    }
+
+    out = (*buffer) + (*offset);
+    *out++ = ' ';
+    memcpy(out, p_name, name_len);
+    out += name_len;
+    *out++ = '=';
+    *out++ = '"';
+    out = __xml_escaped_write(p_value, out);
+    *out++ = '"';
+    *out = 0;
+    (*offset) = out - (*buffer);
 }
 
 static void
@@ -3600,235 +4314,886 @@ dump_xml_element(xmlNode * data, int options, char **buffer, int *offset, int *m
     insert_prefix(options, buffer, offset, max, depth);
     buffer_print(*buffer, *max, *offset, "<%s", name);
 
-    if (options & xml_log_option_filtered) {
-        dump_filtered_xml(data, options, buffer, offset, max);
+    if (options & xml_log_option_filtered) {
+        dump_filtered_xml(data, options, buffer, offset, max);
+
+    } else {
+        xmlAttrPtr xIter = NULL;
+
+        for (xIter = crm_first_attr(data); xIter != NULL; xIter = xIter->next) {
+            dump_xml_attr(xIter, options, buffer, offset, max);
+        }
+    }
+
+    if (data->children == NULL) {
+        buffer_print(*buffer, *max, *offset, "/>");
+
+    } else {
+        buffer_print(*buffer, *max, *offset, ">");
+    }
+
+    if (options & xml_log_option_formatted) {
+        buffer_print(*buffer, *max, *offset, "\n");
+    }
+
+    if (data->children) {
+        xmlNode *xChild = NULL;
+        for(xChild = data->children; xChild != NULL; xChild = xChild->next) {
+            crm_xml_dump(xChild, options, buffer, offset, max, depth + 1);
+        }
+
+        insert_prefix(options, buffer, offset, max, depth);
+        buffer_print(*buffer, *max, *offset, "</%s>", name);
+
+        if (options & xml_log_option_formatted) {
+            buffer_print(*buffer, *max, *offset, "\n");
+        }
+    }
+}
+
+static void
+dump_xml_text(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+{
+    CRM_ASSERT(max != NULL);
+    CRM_ASSERT(offset != NULL);
+    CRM_ASSERT(buffer != NULL);
+
+    if (data == NULL) {
+        crm_trace("Nothing to dump");
+        return;
+    }
+
+    if (*buffer == NULL) {
+        *offset = 0;
+        *max = 0;
+    }
+
+    insert_prefix(options, buffer, offset, max, depth);
+
+    buffer_print(*buffer, *max, *offset, "%s", data->content);
+
+    if (options & xml_log_option_formatted) {
+        buffer_print(*buffer, *max, *offset, "\n");
+    }
+}
+
+
+static void
+dump_xml_comment(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+{
+    CRM_ASSERT(max != NULL);
+    CRM_ASSERT(offset != NULL);
+    CRM_ASSERT(buffer != NULL);
+
+    if (data == NULL) {
+        crm_trace("Nothing to dump");
+        return;
+    }
+
+    if (*buffer == NULL) {
+        *offset = 0;
+        *max = 0;
+    }
+
+    insert_prefix(options, buffer, offset, max, depth);
+
+    buffer_print(*buffer, *max, *offset, "<!--");
+    buffer_print(*buffer, *max, *offset, "%s", data->content);
+    buffer_print(*buffer, *max, *offset, "-->");
+
+    if (options & xml_log_option_formatted) {
+        buffer_print(*buffer, *max, *offset, "\n");
+    }
+}
+
+void
+crm_xml_dump(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+{
+    if(data == NULL) {
+        *offset = 0;
+        *max = 0;
+        return;
+    }
+#if 0
+    if (is_not_set(options, xml_log_option_filtered)) {
+        /* Turning this code on also changes the PE tests for some reason
+         * (not just newlines).  Figure out why before considering to
+         * enable this permanently.
+         *
+         * It exists to help debug slowness in xmlNodeDump() and
+         * potentially if we ever want to go back to it.
+         *
+         * In theory it's a good idea (reuse) but our custom version does
+         * better for the filtered case and avoids the final strdup() for
+         * everything
+         */
+
+        time_t now, next;
+        xmlDoc *doc = NULL;
+        xmlBuffer *xml_buffer = NULL;
+
+        *buffer = NULL;
+        doc = getDocPtr(data);
+        /* doc will only be NULL if data is */
+        CRM_CHECK(doc != NULL, return);
+
+        now = time(NULL);
+        xml_buffer = xmlBufferCreate();
+        CRM_ASSERT(xml_buffer != NULL);
+
+        /* The default allocator XML_BUFFER_ALLOC_EXACT does far too many
+         * realloc()s and it can take upwards of 18 seconds (yes, seconds)
+         * to dump a 28kb tree which XML_BUFFER_ALLOC_DOUBLEIT can do in
+         * less than 1 second.
+         *
+         * We could also use xmlBufferCreateSize() to start with a
+         * sane-ish initial size and avoid the first few doubles.
+         */
+        xmlBufferSetAllocationScheme(xml_buffer, XML_BUFFER_ALLOC_DOUBLEIT);
+
+        *max = xmlNodeDump(xml_buffer, doc, data, 0, (options & xml_log_option_formatted));
+        if (*max > 0) {
+            *buffer = strdup((char *)xml_buffer->content);
+        }
+
+        next = time(NULL);
+        if ((now + 1) < next) {
+            crm_log_xml_trace(data, "Long time");
+            crm_err("xmlNodeDump() -> %dbytes took %ds", *max, next - now);
+        }
+
+        xmlBufferFree(xml_buffer);
+        return;
+    }
+#endif
+
+    switch(data->type) {
+        case XML_ELEMENT_NODE:
+            /* Handle below */
+            dump_xml_element(data, options, buffer, offset, max, depth);
+            break;
+        case XML_TEXT_NODE:
+            /* if option xml_log_option_text is enabled, then dump XML_TEXT_NODE */
+            if (options & xml_log_option_text) {
+                dump_xml_text(data, options, buffer, offset, max, depth);
+            }
+            return;
+        case XML_COMMENT_NODE:
+            dump_xml_comment(data, options, buffer, offset, max, depth);
+            break;
+        default:
+            crm_warn("Unhandled type: %d", data->type);
+            return;
+
+            /*
+            XML_ATTRIBUTE_NODE = 2
+            XML_CDATA_SECTION_NODE = 4
+            XML_ENTITY_REF_NODE = 5
+            XML_ENTITY_NODE = 6
+            XML_PI_NODE = 7
+            XML_DOCUMENT_NODE = 9
+            XML_DOCUMENT_TYPE_NODE = 10
+            XML_DOCUMENT_FRAG_NODE = 11
+            XML_NOTATION_NODE = 12
+            XML_HTML_DOCUMENT_NODE = 13
+            XML_DTD_NODE = 14
+            XML_ELEMENT_DECL = 15
+            XML_ATTRIBUTE_DECL = 16
+            XML_ENTITY_DECL = 17
+            XML_NAMESPACE_DECL = 18
+            XML_XINCLUDE_START = 19
+            XML_XINCLUDE_END = 20
+            XML_DOCB_DOCUMENT_NODE = 21
+            */
+    }
+
+}
+
+static bool
+__xml_digest_filtered(const char *name)
+{
+    int lpc;
+
+    for (lpc = 0; lpc < DIMOF(filter); lpc++) {
+        if (strcmp(name, filter[lpc].string) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static const unsigned char *__xml_subtree_digest(xmlNode *xml);
+
+/*!
+ * \internal
+ * \brief Feed an element's own content, and its children's digests, to MD5
+ *
+ * \param[in]     xml        Element to digest
+ * \param[in]     do_filter  Whether to skip the attributes in filter[]
+ * \param[in,out] ctx        MD5 context to update
+ */
+static void
+__xml_digest_element(xmlNode *xml, gboolean do_filter, struct md5_ctx *ctx)
+{
+    xmlNode *cIter = NULL;
+    xmlAttr *pIter = NULL;
+
+    md5_process_bytes(xml->name, strlen((const char *)xml->name) + 1, ctx);
+
+    for (pIter = crm_first_attr(xml); pIter != NULL; pIter = pIter->next) {
+        xml_private_t *p = pIter->_private;
+        const char *p_name = (const char *)pIter->name;
+        const char *p_value = crm_attr_value(pIter);
+
+        if (p && is_set(p->flags, xpf_deleted)) {
+            continue;
+
+        } else if (do_filter && __xml_digest_filtered(p_name)) {
+            continue;
+        }
+
+        md5_process_bytes("@", 1, ctx);
+        md5_process_bytes(p_name, strlen(p_name) + 1, ctx);
+        if (p_value) {
+            md5_process_bytes(p_value, strlen(p_value), ctx);
+        }
+        md5_process_bytes("", 1, ctx);
+    }
+
+    for (cIter = __xml_first_child(xml); cIter != NULL; cIter = __xml_next(cIter)) {
+        switch (cIter->type) {
+            case XML_ELEMENT_NODE:
+                md5_process_bytes("<", 1, ctx);
+                md5_process_bytes(__xml_subtree_digest(cIter), MD5_DIGEST_SIZE, ctx);
+                break;
+            case XML_COMMENT_NODE:
+                md5_process_bytes("!", 1, ctx);
+                if (cIter->content) {
+                    md5_process_bytes(cIter->content, strlen((const char *)cIter->content), ctx);
+                }
+                md5_process_bytes("", 1, ctx);
+                break;
+            default:
+                /* Text is not part of v2 digests either */
+                break;
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Return the (possibly cached) unfiltered digest of an element
+ *
+ * \param[in] xml  Element to digest
+ *
+ * \return MD5_DIGEST_SIZE bytes owned by \p xml
+ */
+static const unsigned char *
+__xml_subtree_digest(xmlNode *xml)
+{
+    struct md5_ctx ctx;
+    xml_private_t *p = xml->_private;
+
+    CRM_ASSERT(p != NULL);
+    if (p->digest == NULL) {
+        md5_init_ctx(&ctx);
+        __xml_digest_element(xml, FALSE, &ctx);
+
+        p->digest = malloc(MD5_DIGEST_SIZE);
+        CRM_ASSERT(p->digest != NULL);
+        md5_finish_ctx(&ctx, p->digest);
+    }
+    return p->digest;
+}
+
+/*!
+ * \internal
+ * \brief Calculate the Merkle-style digest of an XML tree
+ *
+ * Each element's digest covers its name, attributes and comments plus the
+ * digests of its child elements, and is cached until the element or one of
+ * its descendants is modified.  Recalculating after an update therefore only
+ * visits the changed elements and their ancestors.
+ *
+ * \param[in]  xml        Root of XML to digest
+ * \param[in]  do_filter  Whether to skip filtered attributes of \p xml itself
+ * \param[out] digest     Where to store the MD5_DIGEST_SIZE byte result
+ *
+ * \note The root is never cached when filtering, since the filtered
+ *       attributes (and version details) change with every update anyway.
+ */
+void
+crm_xml_merkle_digest(xmlNode *xml, gboolean do_filter, unsigned char *digest)
+{
+    CRM_ASSERT(xml != NULL && xml->type == XML_ELEMENT_NODE);
+
+    if (do_filter) {
+        struct md5_ctx ctx;
+
+        md5_init_ctx(&ctx);
+        __xml_digest_element(xml, TRUE, &ctx);
+        md5_finish_ctx(&ctx, digest);
+
+    } else {
+        memcpy(digest, __xml_subtree_digest(xml), MD5_DIGEST_SIZE);
+    }
+}
+
+void
+crm_buffer_add_char(char **buffer, int *offset, int *max, char c)
+{
+    buffer_print(*buffer, *max, *offset, "%c", c);
+}
+
+char *
+dump_xml_formatted_with_text(xmlNode * an_xml_node)
+{
+    char *buffer = NULL;
+    int offset = 0, max = 0;
+
+    crm_xml_dump(an_xml_node, xml_log_option_formatted|xml_log_option_text, &buffer, &offset, &max, 0);
+    return buffer;
+}
+
+char *
+dump_xml_formatted(xmlNode * an_xml_node)
+{
+    char *buffer = NULL;
+    int offset = 0, max = 0;
+
+    crm_xml_dump(an_xml_node, xml_log_option_formatted, &buffer, &offset, &max, 0);
+    return buffer;
+}
+
+static inline const char *
+__xml_dump_attr_value(xmlAttrPtr attr)
+{
+    xml_private_t *p = attr->_private;
+
+    if (attr->children == NULL || (p && is_set(p->flags, xpf_deleted))) {
+        return NULL;
+    }
+    return attr->children->content? (const char *)attr->children->content : "";
+}
+
+/*!
+ * \brief Calculate the exact length of the unformatted dump of an XML tree
+ *
+ * \param[in] xml  XML to size
+ *
+ * \return Number of bytes crm_xml_unformatted_write() will write for \p xml,
+ *         excluding the terminating nul
+ */
+size_t
+crm_xml_unformatted_size(xmlNode *xml)
+{
+    size_t len = 0;
+    xmlAttrPtr xIter = NULL;
+    xmlNode *xChild = NULL;
+
+    if (xml == NULL) {
+        return 0;
+    }
+
+    switch(xml->type) {
+        case XML_ELEMENT_NODE:
+            len += 1 + strlen((const char *)xml->name);
+            for (xIter = crm_first_attr(xml); xIter != NULL; xIter = xIter->next) {
+                const char *value = __xml_dump_attr_value(xIter);
+
+                if (value) {
+                    len += 4 + strlen((const char *)xIter->name) + __xml_escaped_len(value);
+                }
+            }
+
+            if (xml->children == NULL) {
+                len += 2;
+
+            } else {
+                len += 1;
+                for (xChild = xml->children; xChild != NULL; xChild = xChild->next) {
+                    len += crm_xml_unformatted_size(xChild);
+                }
+                len += 3 + strlen((const char *)xml->name);
+            }
+            break;
+
+        case XML_COMMENT_NODE:
+            len += 7 + (xml->content? strlen((const char *)xml->content) : 0);
+            break;
+
+        default:
+            /* Text is only dumped when formatting for humans */
+            break;
+    }
+    return len;
+}
+
+/*!
+ * \brief Write the unformatted dump of an XML tree into a buffer
+ *
+ * \param[in]  xml     XML to dump
+ * \param[out] buffer  Where to write, with room for at least
+ *                     crm_xml_unformatted_size(\p xml) + 1 bytes
+ *
+ * \return Position of the terminating nul written to \p buffer
+ *
+ * \note The output matches crm_xml_dump() with no options, but is written
+ *       in a single pass with no intermediate allocations.
+ */
+char *
+crm_xml_unformatted_write(xmlNode *xml, char *buffer)
+{
+    char *out = buffer;
+    size_t len = 0;
+    xmlAttrPtr xIter = NULL;
+    xmlNode *xChild = NULL;
+
+    CRM_ASSERT(buffer != NULL);
+    *out = 0;
+    if (xml == NULL) {
+        return out;
+    }
+
+    switch(xml->type) {
+        case XML_ELEMENT_NODE:
+            len = strlen((const char *)xml->name);
+            *out++ = '<';
+            memcpy(out, xml->name, len);
+            out += len;
+
+            for (xIter = crm_first_attr(xml); xIter != NULL; xIter = xIter->next) {
+                const char *value = __xml_dump_attr_value(xIter);
+                size_t name_len = 0;
+
+                if (value == NULL) {
+                    continue;
+                }
+
+                name_len = strlen((const char *)xIter->name);
+                *out++ = ' ';
+                memcpy(out, xIter->name, name_len);
+                out += name_len;
+                *out++ = '=';
+                *out++ = '"';
+                out = __xml_escaped_write(value, out);
+                *out++ = '"';
+            }
+
+            if (xml->children == NULL) {
+                *out++ = '/';
+                *out++ = '>';
+
+            } else {
+                *out++ = '>';
+                for (xChild = xml->children; xChild != NULL; xChild = xChild->next) {
+                    out = crm_xml_unformatted_write(xChild, out);
+                }
+                *out++ = '<';
+                *out++ = '/';
+                memcpy(out, xml->name, len);
+                out += len;
+                *out++ = '>';
+            }
+            break;
+
+        case XML_COMMENT_NODE:
+            memcpy(out, "<!--", 4);
+            out += 4;
+            if (xml->content) {
+                len = strlen((const char *)xml->content);
+                memcpy(out, xml->content, len);
+                out += len;
+            }
+            memcpy(out, "-->", 3);
+            out += 3;
+            break;
+
+        default:
+            break;
+    }
+
+    *out = 0;
+    return out;
+}
+
+char *
+dump_xml_unformatted(xmlNode * an_xml_node)
+{
+    char *buffer = NULL;
+    size_t len = crm_xml_unformatted_size(an_xml_node);
+
+    if (len == 0) {
+        return NULL;
+    }
+
+    buffer = malloc(len + 1);
+    CRM_ASSERT(buffer != NULL);
+    crm_xml_unformatted_write(an_xml_node, buffer);
+    return buffer;
+}
+
+/* Binary encoding of an XML tree, for local IPC between peers that both
+ * understand it (so host byte order is fine).  Element and attribute names
+ * are interned into a dictionary that follows the tree:
+ *
+ *   header:   magic, dictionary offset, dictionary entries (uint32 each)
+ *   element:  XML_BIN_ELEMENT, name index, attribute count,
+ *             { name index, value length, value + nul } ...,
+ *             child count, children ...
+ *   comment:  XML_BIN_COMMENT, length, text + nul
+ *   dictionary: { length, name + nul } ...
+ *
+ * Text nodes are dropped, as with dump_xml_unformatted().
+ */
+#define XML_BIN_MAGIC     0x31424350 /* "PCB1" */
+#define XML_BIN_ELEMENT   1
+#define XML_BIN_COMMENT   2
+#define XML_BIN_MAX_DEPTH 512
+
+typedef struct xml_bin_buffer_s {
+        char *data;
+        size_t offset;
+        size_t max;
+        GHashTable *names;
+        GPtrArray *dictionary;
+} xml_bin_buffer_t;
+
+static void
+__xml_bin_reserve(xml_bin_buffer_t *buf, size_t len)
+{
+    if (buf->offset + len > buf->max) {
+        buf->max = QB_MAX(QB_MAX(CHUNK_SIZE, buf->max * 2), buf->offset + len);
+        buf->data = realloc_safe(buf->data, buf->max);
+    }
+}
+
+static void
+__xml_bin_put_int(xml_bin_buffer_t *buf, uint32_t value)
+{
+    __xml_bin_reserve(buf, sizeof(uint32_t));
+    memcpy(buf->data + buf->offset, &value, sizeof(uint32_t));
+    buf->offset += sizeof(uint32_t);
+}
+
+static void
+__xml_bin_set_int(xml_bin_buffer_t *buf, size_t offset, uint32_t value)
+{
+    memcpy(buf->data + offset, &value, sizeof(uint32_t));
+}
+
+static void
+__xml_bin_put_string(xml_bin_buffer_t *buf, const char *text)
+{
+    size_t len = strlen(text);
+
+    __xml_bin_put_int(buf, len);
+    __xml_bin_reserve(buf, len + 1);
+    memcpy(buf->data + buf->offset, text, len + 1);
+    buf->offset += len + 1;
+}
 
-    } else {
-        xmlAttrPtr xIter = NULL;
+static void
+__xml_bin_put_name(xml_bin_buffer_t *buf, const xmlChar *name)
+{
+    gpointer index = g_hash_table_lookup(buf->names, name);
 
-        for (xIter = crm_first_attr(data); xIter != NULL; xIter = xIter->next) {
-            dump_xml_attr(xIter, options, buffer, offset, max);
-        }
+    if (index == NULL) {
+        g_ptr_array_add(buf->dictionary, (gpointer) name);
+        index = GUINT_TO_POINTER(buf->dictionary->len);
+        g_hash_table_insert(buf->names, (gpointer) name, index);
     }
+    __xml_bin_put_int(buf, GPOINTER_TO_UINT(index) - 1);
+}
 
-    if (data->children == NULL) {
-        buffer_print(*buffer, *max, *offset, "/>");
+static bool
+__xml_bin_put_node(xml_bin_buffer_t *buf, xmlNode *xml)
+{
+    size_t count_at = 0;
+    uint32_t count = 0;
+    xmlAttrPtr xIter = NULL;
+    xmlNode *xChild = NULL;
 
-    } else {
-        buffer_print(*buffer, *max, *offset, ">");
+    switch(xml->type) {
+        case XML_ELEMENT_NODE:
+            break;
+        case XML_COMMENT_NODE:
+            __xml_bin_reserve(buf, 1);
+            buf->data[buf->offset++] = XML_BIN_COMMENT;
+            __xml_bin_put_string(buf, xml->content? (const char *)xml->content : "");
+            return TRUE;
+        default:
+            return FALSE;
     }
 
-    if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
-    }
+    __xml_bin_reserve(buf, 1);
+    buf->data[buf->offset++] = XML_BIN_ELEMENT;
+    __xml_bin_put_name(buf, xml->name);
 
-    if (data->children) {
-        xmlNode *xChild = NULL;
-        for(xChild = data->children; xChild != NULL; xChild = xChild->next) {
-            crm_xml_dump(xChild, options, buffer, offset, max, depth + 1);
-        }
+    count_at = buf->offset;
+    __xml_bin_put_int(buf, 0);
+    for (xIter = crm_first_attr(xml); xIter != NULL; xIter = xIter->next) {
+        const char *value = __xml_dump_attr_value(xIter);
 
-        insert_prefix(options, buffer, offset, max, depth);
-        buffer_print(*buffer, *max, *offset, "</%s>", name);
+        if (value) {
+            __xml_bin_put_name(buf, xIter->name);
+            __xml_bin_put_string(buf, value);
+            count++;
+        }
+    }
+    __xml_bin_set_int(buf, count_at, count);
 
-        if (options & xml_log_option_formatted) {
-            buffer_print(*buffer, *max, *offset, "\n");
+    count = 0;
+    count_at = buf->offset;
+    __xml_bin_put_int(buf, 0);
+    for (xChild = xml->children; xChild != NULL; xChild = xChild->next) {
+        if (__xml_bin_put_node(buf, xChild)) {
+            count++;
         }
     }
+    __xml_bin_set_int(buf, count_at, count);
+    return TRUE;
 }
 
-static void
-dump_xml_text(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+/*!
+ * \internal
+ * \brief Encode an XML tree in the binary IPC format
+ *
+ * \param[in]  xml     Element to encode
+ * \param[out] length  Where to store the size of the result
+ *
+ * \return Newly allocated encoding (or NULL if \p xml is not an element)
+ */
+char *
+crm_xml_binary_encode(xmlNode *xml, size_t *length)
 {
-    CRM_ASSERT(max != NULL);
-    CRM_ASSERT(offset != NULL);
-    CRM_ASSERT(buffer != NULL);
+    guint lpc = 0;
+    xml_bin_buffer_t buf = { NULL, 0, 0, NULL, NULL };
 
-    if (data == NULL) {
-        crm_trace("Nothing to dump");
-        return;
+    *length = 0;
+    if (xml == NULL || xml->type != XML_ELEMENT_NODE) {
+        return NULL;
     }
 
-    if (*buffer == NULL) {
-        *offset = 0;
-        *max = 0;
+    buf.names = g_hash_table_new(crm_str_hash, g_str_equal);
+    buf.dictionary = g_ptr_array_new();
+
+    __xml_bin_put_int(&buf, XML_BIN_MAGIC);
+    __xml_bin_put_int(&buf, 0);
+    __xml_bin_put_int(&buf, 0);
+    __xml_bin_put_node(&buf, xml);
+
+    __xml_bin_set_int(&buf, sizeof(uint32_t), buf.offset);
+    __xml_bin_set_int(&buf, 2 * sizeof(uint32_t), buf.dictionary->len);
+    for (lpc = 0; lpc < buf.dictionary->len; lpc++) {
+        __xml_bin_put_string(&buf, g_ptr_array_index(buf.dictionary, lpc));
     }
 
-    insert_prefix(options, buffer, offset, max, depth);
+    g_hash_table_destroy(buf.names);
+    g_ptr_array_free(buf.dictionary, TRUE);
 
-    buffer_print(*buffer, *max, *offset, "%s", data->content);
+    *length = buf.offset;
+    return buf.data;
+}
 
-    if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
+typedef struct xml_bin_reader_s {
+        const char *data;
+        size_t offset;
+        size_t end;
+        const char **names;
+        uint32_t n_names;
+} xml_bin_reader_t;
+
+static bool
+__xml_bin_get_int(xml_bin_reader_t *in, uint32_t *value)
+{
+    if (in->end - in->offset < sizeof(uint32_t)) {
+        return FALSE;
     }
+    memcpy(value, in->data + in->offset, sizeof(uint32_t));
+    in->offset += sizeof(uint32_t);
+    return TRUE;
 }
 
+static const char *
+__xml_bin_get_string(xml_bin_reader_t *in)
+{
+    uint32_t len = 0;
+    const char *text = NULL;
 
-static void
-dump_xml_comment(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+    if (__xml_bin_get_int(in, &len) == FALSE
+        || in->end - in->offset <= len || in->data[in->offset + len] != 0) {
+        return NULL;
+    }
+    text = in->data + in->offset;
+    in->offset += len + 1;
+    return text;
+}
+
+static const char *
+__xml_bin_get_name(xml_bin_reader_t *in)
 {
-    CRM_ASSERT(max != NULL);
-    CRM_ASSERT(offset != NULL);
-    CRM_ASSERT(buffer != NULL);
+    uint32_t index = 0;
 
-    if (data == NULL) {
-        crm_trace("Nothing to dump");
-        return;
+    if (__xml_bin_get_int(in, &index) == FALSE || index >= in->n_names) {
+        return NULL;
     }
+    return in->names[index];
+}
 
-    if (*buffer == NULL) {
-        *offset = 0;
-        *max = 0;
+static xmlNode *
+__xml_bin_get_node(xml_bin_reader_t *in, xmlNode *parent, int depth)
+{
+    uint32_t lpc = 0;
+    uint32_t count = 0;
+    const char *name = NULL;
+    xmlNode *xml = NULL;
+
+    if (depth > XML_BIN_MAX_DEPTH || in->offset >= in->end) {
+        return NULL;
     }
 
-    insert_prefix(options, buffer, offset, max, depth);
+    switch (in->data[in->offset++]) {
+        case XML_BIN_ELEMENT:
+            break;
 
-    buffer_print(*buffer, *max, *offset, "<!--");
-    buffer_print(*buffer, *max, *offset, "%s", data->content);
-    buffer_print(*buffer, *max, *offset, "-->");
+        case XML_BIN_COMMENT:
+            name = __xml_bin_get_string(in);
+            if (name == NULL || parent == NULL) {
+                return NULL;
 
-    if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
-    }
-}
+            } else if (strstr(name, "--") || (name[0] && name[strlen(name) - 1] == '-')) {
+                /* Would not survive being written out and parsed again */
+                crm_err("Invalid comment in binary message");
+                return NULL;
+            }
+            xml = xmlNewDocComment(parent->doc, (const xmlChar *)name);
+            xmlAddChild(parent, xml);
+            return xml;
 
-void
-crm_xml_dump(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
-{
-    if(data == NULL) {
-        *offset = 0;
-        *max = 0;
-        return;
+        default:
+            return NULL;
     }
-#if 0
-    if (is_not_set(options, xml_log_option_filtered)) {
-        /* Turning this code on also changes the PE tests for some reason
-         * (not just newlines).  Figure out why before considering to
-         * enable this permanently.
-         *
-         * It exists to help debug slowness in xmlNodeDump() and
-         * potentially if we ever want to go back to it.
-         *
-         * In theory it's a good idea (reuse) but our custom version does
-         * better for the filtered case and avoids the final strdup() for
-         * everything
-         */
 
-        time_t now, next;
-        xmlDoc *doc = NULL;
-        xmlBuffer *xml_buffer = NULL;
+    name = __xml_bin_get_name(in);
+    if (name == NULL || __xml_bin_get_int(in, &count) == FALSE) {
+        return NULL;
+    }
 
-        *buffer = NULL;
-        doc = getDocPtr(data);
-        /* doc will only be NULL if data is */
-        CRM_CHECK(doc != NULL, return);
+    xml = create_xml_node(parent, name);
+    if (xml == NULL) {
+        return NULL;
+    }
 
-        now = time(NULL);
-        xml_buffer = xmlBufferCreate();
-        CRM_ASSERT(xml_buffer != NULL);
+    for (lpc = 0; lpc < count; lpc++) {
+        const char *value = NULL;
 
-        /* The default allocator XML_BUFFER_ALLOC_EXACT does far too many
-         * realloc()s and it can take upwards of 18 seconds (yes, seconds)
-         * to dump a 28kb tree which XML_BUFFER_ALLOC_DOUBLEIT can do in
-         * less than 1 second.
-         *
-         * We could also use xmlBufferCreateSize() to start with a
-         * sane-ish initial size and avoid the first few doubles.
-         */
-        xmlBufferSetAllocationScheme(xml_buffer, XML_BUFFER_ALLOC_DOUBLEIT);
+        name = __xml_bin_get_name(in);
+        value = name? __xml_bin_get_string(in) : NULL;
+        if (value == NULL) {
+            goto bail;
 
-        *max = xmlNodeDump(xml_buffer, doc, data, 0, (options & xml_log_option_formatted));
-        if (*max > 0) {
-            *buffer = strdup((char *)xml_buffer->content);
+        } else if (xmlHasProp(xml, (const xmlChar *)name)) {
+            crm_err("Duplicate %s attribute in binary message", name);
+            goto bail;
         }
+        xmlNewProp(xml, (const xmlChar *)name, (const xmlChar *)value);
+    }
 
-        next = time(NULL);
-        if ((now + 1) < next) {
-            crm_log_xml_trace(data, "Long time");
-            crm_err("xmlNodeDump() -> %dbytes took %ds", *max, next - now);
+    if (__xml_bin_get_int(in, &count) == FALSE) {
+        goto bail;
+    }
+    for (lpc = 0; lpc < count; lpc++) {
+        if (__xml_bin_get_node(in, xml, depth + 1) == NULL) {
+            goto bail;
         }
-
-        xmlBufferFree(xml_buffer);
-        return;
     }
-#endif
-
-    switch(data->type) {
-        case XML_ELEMENT_NODE:
-            /* Handle below */
-            dump_xml_element(data, options, buffer, offset, max, depth);
-            break;
-        case XML_TEXT_NODE:
-            /* if option xml_log_option_text is enabled, then dump XML_TEXT_NODE */
-            if (options & xml_log_option_text) {
-                dump_xml_text(data, options, buffer, offset, max, depth);
-            }
-            return;
-        case XML_COMMENT_NODE:
-            dump_xml_comment(data, options, buffer, offset, max, depth);
-            break;
-        default:
-            crm_warn("Unhandled type: %d", data->type);
-            return;
+    return xml;
 
-            /*
-            XML_ATTRIBUTE_NODE = 2
-            XML_CDATA_SECTION_NODE = 4
-            XML_ENTITY_REF_NODE = 5
-            XML_ENTITY_NODE = 6
-            XML_PI_NODE = 7
-            XML_DOCUMENT_NODE = 9
-            XML_DOCUMENT_TYPE_NODE = 10
-            XML_DOCUMENT_FRAG_NODE = 11
-            XML_NOTATION_NODE = 12
-            XML_HTML_DOCUMENT_NODE = 13
-            XML_DTD_NODE = 14
-            XML_ELEMENT_DECL = 15
-            XML_ATTRIBUTE_DECL = 16
-            XML_ENTITY_DECL = 17
-            XML_NAMESPACE_DECL = 18
-            XML_XINCLUDE_START = 19
-            XML_XINCLUDE_END = 20
-            XML_DOCB_DOCUMENT_NODE = 21
-            */
+  bail:
+    if (parent == NULL) {
+        free_xml(xml);
     }
-
+    return NULL;
 }
 
-void
-crm_buffer_add_char(char **buffer, int *offset, int *max, char c)
+/*!
+ * \internal
+ * \brief Check whether a buffer holds the binary IPC format
+ */
+bool
+crm_xml_is_binary(const char *buffer, size_t length)
 {
-    buffer_print(*buffer, *max, *offset, "%c", c);
+    uint32_t magic = 0;
+
+    if (buffer == NULL || length < 3 * sizeof(uint32_t)) {
+        return FALSE;
+    }
+    memcpy(&magic, buffer, sizeof(uint32_t));
+    return magic == XML_BIN_MAGIC;
 }
 
-char *
-dump_xml_formatted_with_text(xmlNode * an_xml_node)
+/*!
+ * \internal
+ * \brief Decode an XML tree from the binary IPC format
+ *
+ * \param[in]  buffer  Encoded tree (as created by crm_xml_binary_encode())
+ * \param[in]  length  Size of \p buffer
+ * \param[out] xml     Where to store the newly allocated XML
+ *
+ * \return pcmk_ok on success, -EPROTO if \p buffer is not a valid encoding
+ *         of well-formed XML
+ */
+int
+crm_xml_binary_decode(const char *buffer, size_t length, xmlNode **xml)
 {
-    char *buffer = NULL;
-    int offset = 0, max = 0;
+    uint32_t lpc = 0;
+    uint32_t dict_offset = 0;
+    xml_bin_reader_t in = { buffer, 0, length, NULL, 0 };
 
-    crm_xml_dump(an_xml_node, xml_log_option_formatted|xml_log_option_text, &buffer, &offset, &max, 0);
-    return buffer;
-}
+    CRM_CHECK(xml != NULL, return -EINVAL);
+    *xml = NULL;
 
-char *
-dump_xml_formatted(xmlNode * an_xml_node)
-{
-    char *buffer = NULL;
-    int offset = 0, max = 0;
+    if (crm_xml_is_binary(buffer, length) == FALSE) {
+        return -EPROTO;
+    }
 
-    crm_xml_dump(an_xml_node, xml_log_option_formatted, &buffer, &offset, &max, 0);
-    return buffer;
-}
+    in.offset = sizeof(uint32_t);
+    __xml_bin_get_int(&in, &dict_offset);
+    __xml_bin_get_int(&in, &in.n_names);
+    if (dict_offset < in.offset || dict_offset > length
+        || in.n_names > (length - dict_offset) / (sizeof(uint32_t) + 1)) {
+        crm_err("Invalid binary message dictionary");
+        return -EPROTO;
+    }
 
-char *
-dump_xml_unformatted(xmlNode * an_xml_node)
-{
-    char *buffer = NULL;
-    int offset = 0, max = 0;
+    /* Read the dictionary from the end, then the tree that precedes it */
+    in.names = calloc(QB_MAX(in.n_names, 1), sizeof(const char *));
+    CRM_ASSERT(in.names != NULL);
+    in.offset = dict_offset;
+    for (lpc = 0; lpc < in.n_names; lpc++) {
+        in.names[lpc] = __xml_bin_get_string(&in);
 
-    crm_xml_dump(an_xml_node, 0, &buffer, &offset, &max, 0);
-    return buffer;
+        /* Every entry is used as an element or attribute name */
+        if (in.names[lpc] == NULL
+            || xmlValidateName((const xmlChar *) in.names[lpc], 0) != 0) {
+            crm_err("Invalid binary message dictionary entry %u", lpc);
+            free(in.names);
+            return -EPROTO;
+        }
+    }
+
+    in.offset = 3 * sizeof(uint32_t);
+    in.end = dict_offset;
+    *xml = __xml_bin_get_node(&in, NULL, 0);
+    if (*xml == NULL || in.offset != in.end) {
+        crm_err("Invalid binary message");
+        free_xml(*xml);
+        *xml = NULL;
+    }
+
+    free(in.names);
+    return (*xml == NULL)? -EPROTO : pcmk_ok;
 }
 
 gboolean
@@ -3891,10 +5256,12 @@ xml_remove_prop(xmlNode * obj, const char *name)
         p = attr->_private;
         set_parent_flag(obj, xpf_dirty);
         p->flags |= xpf_deleted;
+        __xml_digest_invalidate(obj);
         /* crm_trace("Setting flag %x due to %s[@id=%s].%s", xpf_dirty, obj->name, ID(obj), name); */
 
     } else {
         xmlUnsetProp(obj, (const xmlChar *)name);
+        __xml_digest_invalidate(obj);
     }
 }
 
@@ -4116,6 +5483,7 @@ __xml_diff_object(xmlNode * old, xmlNode * new)
                 crm_attr_dirty(prop);
             } else {
                 xmlUnsetProp(new, prop->name); /* Remove - change not allowed */
+                __xml_digest_invalidate(new);
             }
 
             free(value);
@@ -4586,6 +5954,7 @@ add_xml_comment(xmlNode * parent, xmlNode * target, xmlNode * update)
     } else if (safe_str_neq((const char *)target->content, (const char *)update->content)) {
         xmlFree(target->content);
         target->content = xmlStrdup(update->content);
+        __xml_digest_invalidate(target);
     }
 
     return 0;
@@ -4653,6 +6022,7 @@ add_xml_object(xmlNode * parent, xmlNode * target, xmlNode * update, gboolean as
             xmlUnsetProp(target, (const xmlChar *)p_name);
             xmlSetProp(target, (const xmlChar *)p_name, (const xmlChar *)p_value);
         }
+        __xml_digest_invalidate(target);
     }
 
     for (a_child = __xml_first_child(update); a_child != NULL; a_child = __xml_next(a_child)) {
@@ -4782,6 +6152,7 @@ replace_xml_child(xmlNode * parent, xmlNode * child, xmlNode * update, gboolean
 
             xml_accept_changes(tmp);
             old = xmlReplaceNode(child, tmp);
+            __xml_digest_invalidate(tmp);
 
             if(xml_tracking_changes(tmp)) {
                 /* Replaced sections may have included relevant ACLs */
@@ -5115,6 +6486,22 @@ void
 crm_xml_cleanup(void)
 {
     crm_info("Cleaning up memory from libxml2");
+    crm_debug("XML private data: %lu allocations served by %lu slabs "
+              "(%lu freed, %lu entries in use, peak %lu)",
+              private_stats.allocs, private_stats.slab_allocs,
+              private_stats.slab_frees, private_stats.in_use, private_stats.peak);
+    if(acl_view_cache) {
+        g_hash_table_destroy(acl_view_cache);
+        acl_view_cache = NULL;
+    }
+    if(acl_rule_cache) {
+        g_hash_table_destroy(acl_rule_cache);
+        acl_rule_cache = NULL;
+    }
+    if(acl_xpath_cache) {
+        g_hash_table_destroy(acl_xpath_cache);
+        acl_xpath_cache = NULL;
+    }
     crm_schema_cleanup();
     xmlCleanupParser();
 }
@@ -5176,7 +6563,7 @@ crm_element_value(xmlNode * data, const char *name)
         return NULL;
     }
 
-    attr = xmlHasProp(data, (const xmlChar *)name);
+    attr = __xml_attr_find(data, name);
     if (attr == NULL || attr->children == NULL) {
         return NULL;
     }
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2026 the Pacemaker project contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Microbenchmark for XML serialization.
+ *
+ * Build with "make -C lib/common xml_bench" and run as
+ * "xml_bench -X cib.xml [-n iterations]".
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <crm/crm.h>
+#include <crm/common/ipcs.h>
+#include <crm/common/xml.h>
+#include <crm/common/xml_internal.h>
+
+#define OPTARGS	"X:n:"
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static void
+report(const char *what, double start, int iterations, size_t bytes)
+{
+    double elapsed = now_ms() - start;
+
+    printf("%-24s %8.3f ms/op %10.1f MB/s\n", what, elapsed / iterations,
+           (bytes * (double) iterations) / (elapsed * 1000.0));
+}
+
+int
+main(int argc, char **argv)
+{
+    int flag;
+    int lpc = 0;
+    int iterations = 1000;
+    double start = 0;
+    size_t bytes = 0;
+    unsigned long allocs = 0, slabs = 0;
+    unsigned long allocs_before = 0, slabs_before = 0;
+    char *legacy = NULL;
+    char *sized = NULL;
+    xmlNode *top = NULL;
+    const char *xml_file = NULL;
+
+    crm_log_cli_init("xml_bench");
+    while (1) {
+        flag = getopt(argc, argv, OPTARGS);
+        if (flag == -1)
+            break;
+
+        switch (flag) {
+            case 'X':
+                xml_file = optarg;
+                break;
+            case 'n':
+                iterations = crm_parse_int(optarg, "1000");
+                break;
+            default:
+                printf("Unknown option: -%c\n", flag);
+                return 1;
+        }
+    }
+
+    if (xml_file == NULL || iterations <= 0) {
+        /* filename2xml(NULL) would wait for input on stdin */
+        fprintf(stderr, "Usage: %s -X file.xml [-n iterations]\n", argv[0]);
+        return 1;
+    }
+
+    top = filename2xml(xml_file);
+    if (top == NULL) {
+        fprintf(stderr, "Could not parse %s\n", xml_file);
+        return 1;
+    }
+
+    /* Both serializers must produce identical text */
+    {
+        int offset = 0, max = 0;
+
+        crm_xml_dump(top, 0, &legacy, &offset, &max, 0);
+        sized = dump_xml_unformatted(top);
+        if (legacy == NULL || sized == NULL || strcmp(legacy, sized) != 0) {
+            fprintf(stderr, "Serializers disagree\n");
+            return 1;
+        }
+        bytes = strlen(sized) + 1;
+        free(legacy);
+        free(sized);
+    }
+
+    printf("%s: %lu bytes, %d iterations\n", xml_file, (unsigned long) bytes, iterations);
+
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        int offset = 0, max = 0;
+
+        legacy = NULL;
+        crm_xml_dump(top, 0, &legacy, &offset, &max, 0);
+        free(legacy);
+    }
+    report("crm_xml_dump", start, iterations, bytes);
+
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        sized = dump_xml_unformatted(top);
+        free(sized);
+    }
+    report("dump_xml_unformatted", start, iterations, bytes);
+
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        struct iovec *iov = NULL;
+
+        if (crm_ipc_prepare(0, top, &iov, 0) > 0) {
+            free(iov[0].iov_base);
+            free(iov[1].iov_base);
+            free(iov);
+        }
+    }
+    report("crm_ipc_prepare", start, iterations, bytes);
+
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        xmlNode *copy = NULL;
+
+        sized = dump_xml_unformatted(top);
+        copy = string2xml(sized);
+        free(sized);
+        free_xml(copy);
+    }
+    report("text round trip", start, iterations, bytes);
+
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        size_t length = 0;
+        xmlNode *copy = NULL;
+
+        sized = crm_xml_binary_encode(top, &length);
+        crm_xml_binary_decode(sized, length, &copy);
+        free(sized);
+        free_xml(copy);
+    }
+    report("binary round trip", start, iterations, bytes);
+
+    /* Each xml_private_t used to be a malloc of its own */
+    crm_xml_private_stats(&allocs_before, &slabs_before);
+    start = now_ms();
+    for (lpc = 0; lpc < iterations; lpc++) {
+        xmlNode *copy = copy_xml(top);
+
+        free_xml(copy);
+    }
+    report("copy_xml", start, iterations, bytes);
+
+    crm_xml_private_stats(&allocs, &slabs);
+    printf("%-24s %lu private allocations, %lu mallocs (%lu unpooled)\n",
+           "copy_xml", allocs - allocs_before, slabs - slabs_before,
+           allocs - allocs_before);
+
+    free_xml(top);
+    return 0;
+}
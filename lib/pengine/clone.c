@@ -144,6 +144,11 @@ master_unpack(resource_t * rsc, pe_working_set_t * data_set)
         get_clone_variant_data(clone_data, rsc);
         clone_data->master_max = crm_parse_int(master_max, "1");
         clone_data->master_node_max = crm_parse_int(master_node_max, "1");
+
+        /* Filled in by the policy engine as master scores are parsed */
+        clone_data->master_scores = g_hash_table_new_full(g_direct_hash,
+                                                          g_direct_equal, NULL,
+                                                          (GDestroyNotify) g_hash_table_destroy);
         return TRUE;
     }
     return FALSE;
@@ -611,6 +616,10 @@ clone_free(resource_t * rsc)
         CRM_ASSERT(clone_data->stop_notify == NULL);
         CRM_ASSERT(clone_data->start_notify == NULL);
         CRM_ASSERT(clone_data->promote_notify == NULL);
+
+        if (clone_data->master_scores) {
+            g_hash_table_destroy(clone_data->master_scores);
+        }
     }
 
     common_free(rsc);
@@ -147,6 +147,10 @@ pe_cluster_option pe_opts[] = {
 	  "The number of PE inputs resulting in WARNINGs to save", "Zero to disable, -1 to store unlimited." },
 	{ "pe-input-series-max", NULL, "integer", NULL, "4000", &check_number,
 	  "The number of other PE inputs to save", "Zero to disable, -1 to store unlimited." },
+	{ "pe-memory-limit", NULL, "integer", NULL, "0", &check_number,
+	  "Approximate memory (in MiB) the policy engine may use for a calculation",
+	  "If the estimate made from the CIB's size exceeds this, allocation score logging is skipped"
+	  " and failed operations are not copied, to reduce memory use.  Zero to disable." },
 
 	/* Node health */
 	{ "node-health-strategy", NULL, "enum", "none, migrate-on-red, only-green, progressive, custom", "none", &check_health,
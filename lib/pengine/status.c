@@ -245,6 +245,182 @@ set_working_set_defaults(pe_working_set_t * data_set)
     set_bit(data_set->flags, pe_flag_stop_action_orphans);
 }
 
+/* Rough per-entry overhead of a GHashTable node (key, value and hash) */
+#define PE_HASH_ENTRY_SIZE (2 * sizeof(gpointer) + sizeof(guint))
+
+static size_t
+memory_str_size(const char *str)
+{
+    return str? (strlen(str) + 1) : 0;
+}
+
+static void
+memory_add_str_table(GHashTable *table, pe_memory_usage_t *usage)
+{
+    GHashTableIter iter;
+    const char *key = NULL;
+    const char *value = NULL;
+
+    if (table == NULL) {
+        return;
+    }
+    usage->hash_tables += g_hash_table_size(table) * PE_HASH_ENTRY_SIZE;
+
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &key, (gpointer *) &value)) {
+        usage->strings += memory_str_size(key) + memory_str_size(value);
+    }
+}
+
+static void
+memory_add_node_table(GHashTable *table, pe_memory_usage_t *usage)
+{
+    if (table != NULL) {
+        usage->hash_tables += g_hash_table_size(table) * PE_HASH_ENTRY_SIZE;
+        usage->nodes += g_hash_table_size(table) * sizeof(node_t);
+    }
+}
+
+static void
+memory_add_xml(xmlNode *xml, pe_memory_usage_t *usage)
+{
+    xmlNode *child = NULL;
+    xmlAttr *attr = NULL;
+
+    if (xml == NULL) {
+        return;
+    }
+
+    usage->xml += sizeof(xmlNode) + memory_str_size((const char *) xml->name);
+    for (attr = xml->properties; attr != NULL; attr = attr->next) {
+        /* Each attribute value is held in a text node of its own */
+        usage->xml += sizeof(xmlAttr) + sizeof(xmlNode)
+                      + memory_str_size((const char *) attr->name);
+        if (attr->children) {
+            usage->xml += memory_str_size((const char *) attr->children->content);
+        }
+    }
+
+    for (child = xml->children; child != NULL; child = child->next) {
+        if (child->type == XML_ELEMENT_NODE) {
+            memory_add_xml(child, usage);
+        } else {
+            usage->xml += sizeof(xmlNode)
+                          + memory_str_size((const char *) child->content);
+        }
+    }
+}
+
+static void
+memory_add_resources(GListPtr resources, pe_memory_usage_t *usage)
+{
+    GListPtr gIter = NULL;
+
+    for (gIter = resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+
+        usage->strings += memory_str_size(rsc->id)
+                          + memory_str_size(rsc->clone_name);
+        memory_add_str_table(rsc->meta, usage);
+        memory_add_str_table(rsc->parameters, usage);
+        memory_add_str_table(rsc->utilization, usage);
+        memory_add_node_table(rsc->allowed_nodes, usage);
+        memory_add_node_table(rsc->known_on, usage);
+        memory_add_xml(rsc->orig_xml, usage);
+
+        memory_add_resources(rsc->children, usage);
+    }
+}
+
+/*!
+ * \brief Estimate the memory held by a working set
+ *
+ * Fills in data_set->memory with an approximation of the memory used by the
+ * main categories of scheduler data. Allocator overhead and libxml's private
+ * data are not included, so this is a lower bound suitable for comparing
+ * runs rather than an exact figure.
+ *
+ * \param[in,out] data_set  Cluster working set to measure
+ */
+void
+pe_calculate_memory_usage(pe_working_set_t * data_set)
+{
+    GListPtr gIter = NULL;
+    pe_memory_usage_t *usage = &(data_set->memory);
+
+    memset(usage, 0, sizeof(pe_memory_usage_t));
+
+    for (gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
+        action_t *action = (action_t *) gIter->data;
+
+        usage->actions += sizeof(action_t)
+                          + (g_list_length(action->actions_before)
+                             + g_list_length(action->actions_after))
+                          * (sizeof(action_wrapper_t) + sizeof(GList));
+        usage->strings += memory_str_size(action->uuid)
+                          + memory_str_size(action->task)
+                          + memory_str_size(action->cancel_task)
+                          + memory_str_size(action->reason);
+        if (action->node) {
+            usage->nodes += sizeof(node_t);
+        }
+        memory_add_str_table(action->meta, usage);
+        memory_add_str_table(action->extra, usage);
+    }
+
+    for (gIter = data_set->nodes; gIter != NULL; gIter = gIter->next) {
+        node_t *node = (node_t *) gIter->data;
+
+        usage->nodes += sizeof(node_t) + sizeof(struct node_shared_s);
+        memory_add_str_table(node->details->attrs, usage);
+        memory_add_str_table(node->details->utilization, usage);
+        if (node->details->digest_cache) {
+            usage->hash_tables += g_hash_table_size(node->details->digest_cache)
+                                  * (PE_HASH_ENTRY_SIZE + sizeof(op_digest_cache_t));
+        }
+    }
+
+    memory_add_resources(data_set->resources, usage);
+    memory_add_str_table(data_set->config_hash, usage);
+
+    memory_add_xml(data_set->input, usage);
+    memory_add_xml(data_set->failed, usage);
+    memory_add_xml(data_set->graph, usage);
+}
+
+size_t
+pe_memory_usage_total(const pe_memory_usage_t * usage)
+{
+    return usage->actions + usage->nodes + usage->hash_tables
+           + usage->xml + usage->strings;
+}
+
+/* Resources, node copies and actions built from the input typically need a
+ * few times as much memory again as the input's XML
+ */
+#define PE_MEMORY_INPUT_FACTOR 4
+
+/*!
+ * \brief Estimate the peak memory a calculation will need, from its input
+ *
+ * This only measures the input XML, so it can be used before the status is
+ * unpacked, while there is still a chance to avoid optional allocations.
+ *
+ * \param[in,out] data_set  Cluster working set (input must be set)
+ *
+ * \return Estimated peak (also stored in data_set->memory_estimate)
+ */
+size_t
+pe_estimate_memory_usage(pe_working_set_t * data_set)
+{
+    pe_memory_usage_t usage;
+
+    memset(&usage, 0, sizeof(pe_memory_usage_t));
+    memory_add_xml(data_set->input, &usage);
+    data_set->memory_estimate = usage.xml * PE_MEMORY_INPUT_FACTOR;
+    return data_set->memory_estimate;
+}
+
 resource_t *
 pe_find_resource(GListPtr rsc_list, const char *id)
 {
@@ -333,6 +333,24 @@ unpack_config(xmlNode * config, pe_working_set_t * data_set)
     data_set->placement_strategy = pe_pref(data_set->config_hash, "placement-strategy");
     crm_trace("Placement strategy: %s", data_set->placement_strategy);
 
+    value = pe_pref(data_set->config_hash, "pe-memory-limit");
+    data_set->memory_limit = 0;
+    if (crm_parse_int(value, "0") < 0) {
+        crm_config_err("Ignoring negative pe-memory-limit (%s)", value);
+    } else {
+        data_set->memory_limit = (size_t) crm_parse_int(value, "0") * 1024 * 1024;
+    }
+    crm_trace("Memory limit: %s MiB", crm_str(value));
+
+    /* Decide before the status is unpacked, so optional data is never built */
+    if (data_set->memory_limit && is_set(data_set->flags, pe_flag_limit_memory)
+        && (pe_estimate_memory_usage(data_set) > data_set->memory_limit)) {
+        crm_warn("Reducing memory use: estimated %lluKiB exceeds pe-memory-limit of %lluKiB",
+                 (unsigned long long) data_set->memory_estimate / 1024,
+                 (unsigned long long) data_set->memory_limit / 1024);
+        set_bit(data_set->flags, pe_flag_low_memory);
+    }
+
     return TRUE;
 }
 
@@ -2235,7 +2253,7 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     saved_role = rsc->role;
     on_fail = action_fail_ignore;
     rsc->role = RSC_ROLE_UNKNOWN;
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe_sort_rsc_ops(op_list);
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
         xmlNode *rsc_op = (xmlNode *) gIter->data;
@@ -2580,6 +2598,10 @@ record_failed_op(xmlNode *op, node_t* node, resource_t *rsc, pe_working_set_t *
 
     if (node->details->online == FALSE) {
         return;
+
+    } else if (is_set(data_set->flags, pe_flag_low_memory)) {
+        /* The copies are only informational */
+        return;
     }
 
     for (xIter = data_set->failed->children; xIter; xIter = xIter->next) {
@@ -3383,7 +3405,7 @@ extract_operations(const char *node, const char *rsc, xmlNode * rsc_entry, gbool
         return NULL;
     }
 
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe_sort_rsc_ops(op_list);
 
     /* create active recurring operations as optional */
     if (active_filter == FALSE) {
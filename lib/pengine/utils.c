@@ -247,6 +247,12 @@ dump_node_scores_worker(int level, const char *file, const char *function, int l
         return;
     }
 
+    if (level != 0 && rsc && rsc->cluster
+        && is_set(rsc->cluster->flags, pe_flag_low_memory)) {
+        /* Logging scores is expendable when memory is tight */
+        return;
+    }
+
     if (level == 0) {
         char score[128];
         int len = sizeof(score);
@@ -1671,6 +1677,84 @@ sort_op_by_callid(gconstpointer a, gconstpointer b)
 
 }
 
+struct op_call_id_s {
+    int call_id;
+    xmlNode *xml;
+};
+
+static int
+compare_op_call_ids(const void *a, const void *b)
+{
+    const struct op_call_id_s *op_a = a;
+    const struct op_call_id_s *op_b = b;
+
+    return (op_a->call_id > op_b->call_id) - (op_a->call_id < op_b->call_id);
+}
+
+/*!
+ * \internal
+ * \brief Sort a resource's operation history into execution order
+ *
+ * Equivalent to g_list_sort(op_list, sort_op_by_callid), but each entry's
+ * call ID is parsed only once. The full comparison (which falls back to
+ * last-rc-change and transition keys, and complains about duplicate
+ * entries) is only needed when an entry is pending, or two entries share
+ * a call ID or an ID, so the common case is a plain integer sort.
+ *
+ * \param[in,out] op_list  List of lrm_rsc_op entries (reused for the result)
+ *
+ * \return Sorted list
+ */
+GListPtr
+pe_sort_rsc_ops(GListPtr op_list)
+{
+    guint lpc = 0;
+    guint len = g_list_length(op_list);
+    GListPtr gIter = NULL;
+    GHashTable *ids = NULL;
+    struct op_call_id_s *ops = NULL;
+
+    if (len < 2) {
+        return op_list;
+    }
+
+    ops = calloc(len, sizeof(struct op_call_id_s));
+    CRM_ASSERT(ops != NULL);
+    ids = g_hash_table_new(crm_str_hash, g_str_equal);
+
+    for (gIter = op_list; gIter != NULL; gIter = gIter->next, lpc++) {
+        const char *id = NULL;
+
+        ops[lpc].xml = (xmlNode *) gIter->data;
+        ops[lpc].call_id = -1;
+        crm_element_value_int(ops[lpc].xml, XML_LRM_ATTR_CALLID, &(ops[lpc].call_id));
+        id = ID(ops[lpc].xml);
+
+        if ((ops[lpc].call_id < 0) || (id == NULL) || g_hash_table_lookup(ids, id)) {
+            free(ops);
+            g_hash_table_destroy(ids);
+            return g_list_sort(op_list, sort_op_by_callid);
+        }
+        g_hash_table_insert(ids, (gpointer) id, ops[lpc].xml);
+    }
+    g_hash_table_destroy(ids);
+
+    qsort(ops, len, sizeof(struct op_call_id_s), compare_op_call_ids);
+
+    for (lpc = 1; lpc < len; lpc++) {
+        if (ops[lpc].call_id == ops[lpc - 1].call_id) {
+            free(ops);
+            return g_list_sort(op_list, sort_op_by_callid);
+        }
+    }
+
+    for (gIter = op_list, lpc = 0; gIter != NULL; gIter = gIter->next, lpc++) {
+        gIter->data = ops[lpc].xml;
+    }
+    free(ops);
+    return op_list;
+}
+
 time_t
 get_effective_time(pe_working_set_t * data_set)
 {
@@ -48,6 +48,10 @@ typedef struct clone_variant_data_s {
 
     gboolean notify_confirm;
 
+    GHashTable *master_scores;  /* resource_t* -> (node details -> score) */
+    int master_score_entries;
+    int master_score_hits;
+
 } clone_variant_data_t;
 
 #    define get_clone_variant_data(data, rsc)				\
@@ -488,9 +488,9 @@ ipc_proxy_cleanup(void)
         g_hash_table_destroy(ipc_clients);
     }
     cib_ipc_servers_destroy(cib_ro, cib_rw, cib_shm);
-    qb_ipcs_destroy(attrd_ipcs);
-    qb_ipcs_destroy(stonith_ipcs);
-    qb_ipcs_destroy(crmd_ipcs);
+    mainloop_del_ipc_server(attrd_ipcs);
+    mainloop_del_ipc_server(stonith_ipcs);
+    mainloop_del_ipc_server(crmd_ipcs);
     cib_ro = NULL;
     cib_rw = NULL;
     cib_shm = NULL;
@@ -444,7 +444,7 @@ check_actions_for(xmlNode * rsc_entry, resource_t * rsc, node_t * node, pe_worki
         }
     }
 
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe_sort_rsc_ops(op_list);
     calculate_active_ops(sorted_op_list, &start_index, &stop_index);
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
@@ -707,53 +707,70 @@ check_migration_threshold(resource_t *rsc, node_t *node,
 }
 
 static void
-common_apply_stickiness(resource_t * rsc, node_t * node, pe_working_set_t * data_set)
+apply_stickiness(resource_t *rsc, node_t *node, pe_working_set_t *data_set)
 {
-    if (rsc->children) {
-        GListPtr gIter = rsc->children;
+    node_t *match = pe_hash_table_lookup(rsc->allowed_nodes, node->details->id);
 
-        for (; gIter != NULL; gIter = gIter->next) {
+    if (match != NULL || is_set(data_set->flags, pe_flag_symmetric_cluster)) {
+        resource_location(rsc, node, rsc->stickiness, "stickiness", data_set);
+        pe_rsc_debug(rsc, "Resource %s: preferring current location"
+                     " (node=%s, weight=%d)", rsc->id,
+                     node->details->uname, rsc->stickiness);
+    } else {
+        GHashTableIter iter;
+        node_t *nIter = NULL;
+
+        pe_rsc_debug(rsc, "Ignoring stickiness for %s: the cluster is asymmetric"
+                     " and node %s is not explicitly allowed", rsc->id, node->details->uname);
+        g_hash_table_iter_init(&iter, rsc->allowed_nodes);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&nIter)) {
+            crm_err("%s[%s] = %d", rsc->id, nIter->details->uname, nIter->weight);
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Apply stickiness and migration threshold for a resource
+ *
+ * Stickiness only matters on the node a resource is currently running on, so
+ * only that node is considered for it. Failures may have been recorded on any
+ * node (even one without operation history for the resource), so every node is
+ * checked against the migration threshold.
+ *
+ * \param[in,out] rsc       Resource to check
+ * \param[in,out] data_set  Cluster working set to update
+ */
+static void
+common_apply_stickiness(resource_t * rsc, pe_working_set_t * data_set)
+{
+    GListPtr gIter = NULL;
+
+    if (rsc->children) {
+        for (gIter = rsc->children; gIter != NULL; gIter = gIter->next) {
             resource_t *child_rsc = (resource_t *) gIter->data;
 
-            common_apply_stickiness(child_rsc, node, data_set);
+            common_apply_stickiness(child_rsc, data_set);
         }
         return;
     }
 
     if (is_set(rsc->flags, pe_rsc_managed)
         && rsc->stickiness != 0 && g_list_length(rsc->running_on) == 1) {
-        node_t *current = pe_find_node_id(rsc->running_on, node->details->id);
-        node_t *match = pe_hash_table_lookup(rsc->allowed_nodes, node->details->id);
-
-        if (current == NULL) {
+        apply_stickiness(rsc, (node_t *) rsc->running_on->data, data_set);
+    }
 
-        } else if (match != NULL || is_set(data_set->flags, pe_flag_symmetric_cluster)) {
-            resource_t *sticky_rsc = rsc;
+    for (gIter = data_set->nodes; gIter != NULL; gIter = gIter->next) {
+        node_t *node = (node_t *) gIter->data;
 
-            resource_location(sticky_rsc, node, rsc->stickiness, "stickiness", data_set);
-            pe_rsc_debug(sticky_rsc, "Resource %s: preferring current location"
-                         " (node=%s, weight=%d)", sticky_rsc->id,
-                         node->details->uname, rsc->stickiness);
-        } else {
-            GHashTableIter iter;
-            node_t *nIter = NULL;
-
-            pe_rsc_debug(rsc, "Ignoring stickiness for %s: the cluster is asymmetric"
-                         " and node %s is not explicitly allowed", rsc->id, node->details->uname);
-            g_hash_table_iter_init(&iter, rsc->allowed_nodes);
-            while (g_hash_table_iter_next(&iter, NULL, (void **)&nIter)) {
-                crm_err("%s[%s] = %d", rsc->id, nIter->details->uname, nIter->weight);
-            }
+        /* Check the migration threshold only if a failcount clear action
+         * has not already been placed for this resource on the node.
+         * There is no sense in potentially forcing the resource from this
+         * node if the failcount is being reset anyway. */
+        if (failcount_clear_action_exists(node, rsc) == FALSE) {
+            check_migration_threshold(rsc, node, data_set);
         }
     }
-
-    /* Check the migration threshold only if a failcount clear action
-     * has not already been placed for this resource on the node.
-     * There is no sense in potentially forcing the resource from this
-     * node if the failcount is being reset anyway. */
-    if (failcount_clear_action_exists(node, rsc) == FALSE) {
-        check_migration_threshold(rsc, node, data_set);
-    }
 }
 
 void
@@ -1004,17 +1021,18 @@ stage2(pe_working_set_t * data_set)
 
     apply_placement_constraints(data_set);
 
-    gIter = data_set->nodes;
+    gIter = data_set->resources;
     for (; gIter != NULL; gIter = gIter->next) {
-        GListPtr gIter2 = NULL;
-        node_t *node = (node_t *) gIter->data;
+        resource_t *rsc = (resource_t *) gIter->data;
 
-        gIter2 = data_set->resources;
-        for (; gIter2 != NULL; gIter2 = gIter2->next) {
-            resource_t *rsc = (resource_t *) gIter2->data;
+        common_apply_stickiness(rsc, data_set);
+
+        if (rsc->exclusive_discover) {
+            GListPtr gIter2 = data_set->nodes;
 
-            common_apply_stickiness(rsc, node, data_set);
-            rsc_discover_filter(rsc, node);
+            for (; gIter2 != NULL; gIter2 = gIter2->next) {
+                rsc_discover_filter(rsc, (node_t *) gIter2->data);
+            }
         }
     }
 
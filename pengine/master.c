@@ -28,6 +28,9 @@
 
 extern gint sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set);
 
+/* Marks a cached master score that is absent or does not apply */
+#define MASTER_SCORE_UNSET G_MININT
+
 static void
 child_promoting_constraints(clone_variant_data_t * clone_data, enum pe_ordering type,
                             resource_t * rsc, resource_t * child, resource_t * last,
@@ -461,31 +464,21 @@ lookup_master_score(resource_t * rsc, node_t *node, const char *name)
     return attr_value;
 }
 
+/*!
+ * \internal
+ * \brief Look up the master score an instance has been given on a node
+ *
+ * \param[in] rsc   Primitive clone instance to check
+ * \param[in] node  Node to check
+ *
+ * \return Score from the instance's master attribute on \p node, or
+ *         MASTER_SCORE_UNSET if there is none or it does not apply
+ */
 static int
-master_score(resource_t * rsc, node_t * node, int not_set_value)
+master_score_from_attrs(resource_t * rsc, node_t * node)
 {
     char *name = rsc->id;
     const char *attr_value = NULL;
-    int score = not_set_value;
-    node_t *match = NULL;
-
-    CRM_CHECK(node != NULL, return not_set_value);
-
-    if (rsc->children) {
-        GListPtr gIter = rsc->children;
-
-        for (; gIter != NULL; gIter = gIter->next) {
-            resource_t *child = (resource_t *) gIter->data;
-            int c_score = master_score(child, node, not_set_value);
-
-            if (score == not_set_value) {
-                score = c_score;
-            } else {
-                score += c_score;
-            }
-        }
-        return score;
-    }
 
     if (is_not_set(rsc->flags, pe_rsc_unique) && filter_anonymous_instance(rsc, node)) {
         pe_rsc_trace(rsc, "Anonymous clone %s is allowed on %s", rsc->id, node->details->uname);
@@ -498,25 +491,15 @@ master_score(resource_t * rsc, node_t * node, int not_set_value)
          * master scores set previously.
          */
         node_t *known = pe_hash_table_lookup(rsc->known_on, node->details->id);
+        node_t *match = pe_find_node_id(rsc->running_on, node->details->id);
 
-        match = pe_find_node_id(rsc->running_on, node->details->id);
         if ((match == NULL) && (known == NULL)) {
             pe_rsc_trace(rsc, "skipping %s (aka. %s) master score on %s because inactive",
                          rsc->id, rsc->clone_name, node->details->uname);
-            return score;
+            return MASTER_SCORE_UNSET;
         }
     }
 
-    match = pe_hash_table_lookup(rsc->allowed_nodes, node->details->id);
-    if (match == NULL) {
-        return score;
-
-    } else if (match->weight < 0) {
-        pe_rsc_trace(rsc, "%s on %s has score: %d - ignoring",
-                     rsc->id, match->details->uname, match->weight);
-        return score;
-    }
-
     if (rsc->clone_name) {
         /* Use the name the lrm knows this resource as,
          * since that's what crm_master would have used too
@@ -542,13 +525,90 @@ master_score(resource_t * rsc, node_t * node, int not_set_value)
         free(name);
     }
 
-    if (attr_value != NULL) {
-        score = char2score(attr_value);
+    return (attr_value == NULL)? MASTER_SCORE_UNSET : char2score(attr_value);
+}
+
+/*!
+ * \internal
+ * \brief Get an instance's master score on a node, parsing it only once
+ *
+ * Node attributes and resource history do not change while a transition is
+ * being calculated, so the parsed score is kept in a per-clone table keyed by
+ * instance and node, and later lookups are served from there.
+ *
+ * \param[in] rsc   Primitive clone instance to check
+ * \param[in] node  Node to check
+ *
+ * \return Master score of \p rsc on \p node, or MASTER_SCORE_UNSET
+ */
+static int
+cached_master_score(resource_t * rsc, node_t * node)
+{
+    int score = MASTER_SCORE_UNSET;
+    gpointer value = NULL;
+    GHashTable *scores = NULL;
+    resource_t *parent = uber_parent(rsc);
+    clone_variant_data_t *clone_data = NULL;
+
+    if (parent->variant != pe_master) {
+        return master_score_from_attrs(rsc, node);
+    }
+
+    get_clone_variant_data(clone_data, parent);
+    scores = g_hash_table_lookup(clone_data->master_scores, rsc);
+    if (scores == NULL) {
+        scores = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(clone_data->master_scores, rsc, scores);
+
+    } else if (g_hash_table_lookup_extended(scores, node->details, NULL, &value)) {
+        clone_data->master_score_hits++;
+        return GPOINTER_TO_INT(value);
     }
 
+    score = master_score_from_attrs(rsc, node);
+    g_hash_table_insert(scores, node->details, GINT_TO_POINTER(score));
+    clone_data->master_score_entries++;
     return score;
 }
 
+static int
+master_score(resource_t * rsc, node_t * node, int not_set_value)
+{
+    int score = not_set_value;
+    node_t *match = NULL;
+
+    CRM_CHECK(node != NULL, return not_set_value);
+
+    if (rsc->children) {
+        GListPtr gIter = rsc->children;
+
+        for (; gIter != NULL; gIter = gIter->next) {
+            resource_t *child = (resource_t *) gIter->data;
+            int c_score = master_score(child, node, not_set_value);
+
+            if (score == not_set_value) {
+                score = c_score;
+            } else {
+                score += c_score;
+            }
+        }
+        return score;
+    }
+
+    match = pe_hash_table_lookup(rsc->allowed_nodes, node->details->id);
+    if (match == NULL) {
+        return score;
+
+    } else if (match->weight < 0) {
+        pe_rsc_trace(rsc, "%s on %s has score: %d - ignoring",
+                     rsc->id, match->details->uname, match->weight);
+        return score;
+    }
+
+    score = cached_master_score(rsc, node);
+    return (score == MASTER_SCORE_UNSET)? not_set_value : score;
+}
+
 static void
 apply_master_prefs(resource_t * rsc)
 {
@@ -813,6 +873,9 @@ master_color(resource_t * rsc, node_t * prefer, pe_working_set_t * data_set)
     clone_data->masters_allocated = promoted;
     pe_rsc_info(rsc, "%s: Promoted %d instances of a possible %d to master",
                 rsc->id, promoted, clone_data->master_max);
+    pe_rsc_debug(rsc, "%s: Parsed %d master scores (%d cached lookups)",
+                 rsc->id, clone_data->master_score_entries,
+                 clone_data->master_score_hits);
 
     clear_bit(rsc->flags, pe_rsc_provisional);
     clear_bit(rsc->flags, pe_rsc_allocating);
@@ -224,6 +224,7 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * n
 {
     GListPtr gIter = NULL;
     int rsc_log_level = LOG_INFO;
+    size_t used = 0;
 
 /*	pe_debug_on(); */
 
@@ -234,6 +235,9 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * n
         data_set->input = xml_input;
         data_set->now = now;
 
+        /* Only the policy engine itself trades detail for memory */
+        set_bit(data_set->flags, pe_flag_limit_memory);
+
     } else {
         crm_trace("Already have status - reusing");
     }
@@ -282,6 +286,26 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * n
     crm_trace("Create transition graph");
     stage8(data_set);
 
+    /* Always account for memory use, but only complain about it given a limit
+     * (without which unpacking didn't need an estimate)
+     */
+    if ((data_set->memory_estimate == 0) && data_set->input) {
+        pe_estimate_memory_usage(data_set);
+    }
+    pe_calculate_memory_usage(data_set);
+    used = pe_memory_usage_total(&(data_set->memory));
+    do_crm_log(((data_set->memory_limit > 0) && (used > data_set->memory_limit))?
+               LOG_WARNING : LOG_DEBUG,
+               "Calculation used approximately %lluKiB (estimated %lluKiB): actions=%lluKiB"
+               " nodes=%lluKiB hash-tables=%lluKiB xml=%lluKiB strings=%lluKiB",
+               (unsigned long long) used / 1024,
+               (unsigned long long) data_set->memory_estimate / 1024,
+               (unsigned long long) data_set->memory.actions / 1024,
+               (unsigned long long) data_set->memory.nodes / 1024,
+               (unsigned long long) data_set->memory.hash_tables / 1024,
+               (unsigned long long) data_set->memory.xml / 1024,
+               (unsigned long long) data_set->memory.strings / 1024);
+
     crm_trace("=#=#=#=#= Summary =#=#=#=#=");
     crm_trace("\t========= Set %d (Un-runnable) =========", -1);
     if (get_crm_log_level() >= LOG_TRACE) {
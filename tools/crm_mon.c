@@ -1530,7 +1530,7 @@ print_rsc_history(FILE *stream, pe_working_set_t *data_set, node_t *node,
             op_list = g_list_append(op_list, rsc_op);
         }
     }
-    op_list = g_list_sort(op_list, sort_op_by_callid);
+    op_list = pe_sort_rsc_ops(op_list);
 
     /* Print each operation */
     for (gIter = op_list; gIter != NULL; gIter = gIter->next) {
@@ -513,6 +513,32 @@ static struct crm_option long_options[] = {
 };
 /* *INDENT-ON* */
 
+static void
+profile_promotions(GListPtr resources)
+{
+    GListPtr gIter = NULL;
+
+    for (gIter = resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        GListPtr cIter = NULL;
+
+        if (rsc->variant != pe_master) {
+            profile_promotions(rsc->children);
+            continue;
+        }
+
+        for (cIter = rsc->children; cIter != NULL; cIter = cIter->next) {
+            resource_t *child = (resource_t *) cIter->data;
+            node_t *chosen = child->fns->location(child, NULL, FALSE);
+
+            if (child->next_role == RSC_ROLE_MASTER) {
+                printf("  - Promote %s on %s (score %d)\n", child->id,
+                       (chosen? chosen->details->uname : "none"), child->sort_index);
+            }
+        }
+    }
+}
+
 static void
 profile_one(const char *xml_file)
 {
@@ -540,6 +566,7 @@ profile_one(const char *xml_file)
     data_set.input = cib_object;
     get_date(&data_set);
     do_calculations(&data_set, cib_object, NULL);
+    profile_promotions(data_set.resources);
 
     cleanup_alloc_calculations(&data_set);
 }